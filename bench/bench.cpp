@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+/* system include */
+#include <getopt.h>
+#include <sys/stat.h>
+
+/* project include */
+#include "io.hpp"
+#include "stats.hpp"
+#include "sweep.hpp"
+#include "parser.hpp"
+#include "tokenizer.hpp"
+#include "filter.hpp"
+#include "analysis.hpp"
+#include "generator.hpp"
+
+namespace { // Local definitions
+
+// Work done by one run of a benchmark
+struct work {
+    std::uint64_t items;
+    std::uint64_t bytes;
+};
+
+std::uint64_t file_size(const std::string& filename) {
+    struct stat st;
+    return ::stat(filename.c_str(), &st) == 0 ? std::uint64_t(st.st_size) : 0;
+}
+
+// Keep the best of repeat runs, print one TSV line. reset() is called before each run, out of the timing.
+template<typename F, typename R>
+void measure(const std::string& name, const std::string& items_unit, unsigned nb_threads, unsigned repeat, F&& f, R&& reset) {
+    double best = 0;
+    work done = {0, 0};
+    for(unsigned i = 0 ; i < repeat ; i++) {
+        reset();
+        auto start = std::chrono::steady_clock::now();
+        done = f();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(i == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    best = std::max(best, 1e-9);
+
+    std::cout << name << '\t' << nb_threads << '\t' << best << '\t' << done.items << '\t' << items_unit << '\t'
+              << double(done.items) / best << '\t' << double(done.bytes) / best / 1e6 << '\t' << yacrd::stats::peak_rss_kb() << std::endl;
+}
+
+template<typename F>
+void measure(const std::string& name, const std::string& items_unit, unsigned nb_threads, unsigned repeat, F&& f) {
+    measure(name, items_unit, nb_threads, repeat, f, []() {});
+}
+
+// Coverage of all reads of read2mapping with engine
+work sweep_all(yacrd::sweep::engine engine, yacrd::utils::read2mapping_csr& read2mapping) {
+    const std::vector<std::uint64_t> coverage_mins = {0};
+    yacrd::sweep::workspace ws;
+    std::vector<yacrd::sweep::gaps> gaps;
+    for(yacrd::utils::read_id id = 0 ; id < read2mapping.size() ; id++) {
+        yacrd::sweep::run(engine, read2mapping.begin(id), read2mapping.end(id), read2mapping.lengths[id], coverage_mins, ws, gaps);
+    }
+    return work{read2mapping.offsets.back(), read2mapping.offsets.back() * sizeof(yacrd::utils::interval)};
+}
+
+// Parse all lines of a file in memory with a runtime selected line parser
+work parse_lines(const std::string& filename, yacrd::parser::parser_t parse) {
+    yacrd::io::line_reader reader(filename);
+    yacrd::parser::alignment alignment;
+    work done = {0, 0};
+    const char* begin;
+    const char* end;
+    while(reader.next(begin, end)) {
+        done.bytes += std::uint64_t(end - begin);
+        yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+            done.items += parse(line_begin, line_end, alignment, false);
+        });
+    }
+    return done;
+}
+
+// Split all lines of a file in fields, without parsing them
+template<char Sep>
+work split_fields(const std::string& filename) {
+    yacrd::io::line_reader reader(filename);
+    yacrd::utils::string_ref field;
+    work done = {0, 0};
+    const char* begin;
+    const char* end;
+    while(reader.next(begin, end)) {
+        done.bytes += std::uint64_t(end - begin);
+        yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+            yacrd::parser::tokenizer<Sep> tok(line_begin, line_end);
+            while(tok.field(field)) {
+                done.items++;
+            }
+        });
+    }
+    return done;
+}
+
+void run(const std::string& prefix, unsigned nb_threads, unsigned repeat) {
+    const std::string paf = prefix + ".paf";
+    const std::string mhap = prefix + ".mhap";
+    const std::string fastq = prefix + ".fastq";
+
+    std::cout << "benchmark\tthreads\tseconds\titems\tunit\titems_per_second\tmegabytes_per_second\tprocess_peak_rss_kb" << std::endl;
+
+    measure("tokenizer::paf", "fields", 1, repeat, [&]() { return split_fields<'\t'>(paf); });
+    measure("tokenizer::mhap", "fields", 1, repeat, [&]() { return split_fields<' '>(mhap); });
+    measure("paf_line", "lines", 1, repeat, [&]() { return parse_lines(paf, yacrd::parser::paf_line); });
+    measure("mhap_line", "lines", 1, repeat, [&]() { return parse_lines(mhap, yacrd::parser::mhap_line); });
+
+    yacrd::utils::read2mapping_csr read2mapping;
+    yacrd::parser::prefilter_counts dropped;
+    measure("parser::file", "intervals", nb_threads, repeat, [&]() {
+        yacrd::parser::file(paf, read2mapping, dropped, nb_threads);
+        return work{read2mapping.offsets.back(), file_size(paf)};
+    });
+
+    // heap sorts the intervals of each read, each run starts from the parsed order
+    const std::vector<yacrd::utils::interval> parsed(read2mapping.intervals.data(), read2mapping.intervals.data() + read2mapping.offsets.back());
+    auto restore = [&]() { std::copy(parsed.begin(), parsed.end(), read2mapping.intervals.data()); };
+    measure("sweep::events", "intervals", 1, repeat, [&]() { return sweep_all(yacrd::sweep::engine::events, read2mapping); }, restore);
+    measure("sweep::heap", "intervals", 1, repeat, [&]() { return sweep_all(yacrd::sweep::engine::heap, read2mapping); }, restore);
+
+    // merged works on the union of the intervals of each read, built by the parser
+    measure("parser::file merged", "intervals", nb_threads, repeat, [&]() {
+        yacrd::parser::file(paf, read2mapping, dropped, nb_threads, nullptr, yacrd::parser::prefilter(), true);
+        return work{read2mapping.offsets.back(), file_size(paf)};
+    });
+    measure("sweep::merged", "intervals", 1, repeat, [&]() { return sweep_all(yacrd::sweep::engine::merged, read2mapping); });
+    read2mapping = yacrd::utils::read2mapping_csr();
+
+    yacrd::analysis::config cfg;
+    cfg.nb_threads = nb_threads;
+    cfg.report = "/dev/null";
+    yacrd::utils::read_set remove_reads;
+    measure("find_chimera", "bytes", nb_threads, repeat, [&]() {
+        yacrd::analysis::find_chimera(paf, cfg, remove_reads);
+        return work{file_size(paf), file_size(paf)};
+    });
+
+    for(auto& filename : {fastq, paf}) {
+        measure("filter::read_write " + filename.substr(filename.find_last_of('.') + 1), "bytes", nb_threads, repeat, [&]() {
+            yacrd::filter::read_write(filename, "/dev/null", remove_reads, nb_threads);
+            return work{file_size(filename), file_size(filename)};
+        });
+    }
+}
+
+void print_help() {
+    std::cerr<<"usage: yacrd_bench generate [--reads n] [--depth d] [--chimera-rate r] [--length-mean l] [--length-sd s] [--seed s] prefix\n";
+    std::cerr<<"       yacrd_bench run [-t threads] [-r repeat] prefix\n";
+    std::cerr<<"\n";
+    std::cerr<<"generate writes prefix.paf, prefix.mhap and prefix.fastq, the same options give the same files\n";
+    std::cerr<<"run prints a TSV line per benchmark: best time of the repeats, throughput and peak RSS of the process\n";
+    std::cerr<<"process_peak_rss_kb is the peak since the start of run, it never goes down from one benchmark to the next\n";
+    std::cerr<<std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        print_help();
+        return -1;
+    }
+
+    const std::string command = argv[1];
+    yacrd::bench::workload w;
+    unsigned nb_threads = 1;
+    unsigned repeat = 3;
+
+    const struct option longopts[] =
+    {
+        {"reads", required_argument, 0, 'n'},
+        {"depth", required_argument, 0, 'd'},
+        {"chimera-rate", required_argument, 0, 'x'},
+        {"length-mean", required_argument, 0, 'l'},
+        {"length-sd", required_argument, 0, 's'},
+        {"seed", required_argument, 0, 'S'},
+        {"threads", required_argument, 0, 't'},
+        {"repeat", required_argument, 0, 'r'},
+        {0, 0, 0, 0}
+    };
+
+    optind = 2;
+    int c;
+    while((c = getopt_long(argc, argv, "t:r:", longopts, nullptr)) != -1)
+    {
+        switch(c)
+        {
+            case 'n': w.nb_reads = std::strtoull(optarg, nullptr, 10); break;
+            case 'd': w.depth = std::atof(optarg); break;
+            case 'x': w.chimera_rate = std::atof(optarg); break;
+            case 'l': w.length_mean = std::strtoull(optarg, nullptr, 10); break;
+            case 's': w.length_sd = std::strtoull(optarg, nullptr, 10); break;
+            case 'S': w.seed = std::strtoull(optarg, nullptr, 10); break;
+            case 't': nb_threads = unsigned(std::max(1, std::atoi(optarg))); break;
+            case 'r': repeat = unsigned(std::max(1, std::atoi(optarg))); break;
+            default:
+                print_help();
+                return -1;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        print_help();
+        return -1;
+    }
+    const std::string prefix = argv[optind];
+
+    if(command == "generate")
+    {
+        std::size_t nb_alignments = yacrd::bench::generate(w, prefix);
+        std::cerr << "Generated " << w.nb_reads << " reads and " << nb_alignments << " alignments in " << prefix << ".{paf,mhap,fastq}" << std::endl;
+    }
+    else if(command == "run")
+    {
+        run(prefix, nb_threads, repeat);
+    }
+    else
+    {
+        print_help();
+        return -1;
+    }
+
+    return 0;
+}
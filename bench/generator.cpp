@@ -0,0 +1,178 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <cmath>
+#include <vector>
+#include <cstdio>
+#include <algorithm>
+
+/* project include */
+#include "io.hpp"
+#include "generator.hpp"
+
+namespace { // Local definitions
+
+// splitmix64, standard distributions are implementation defined so they aren't used
+class rng
+{
+public:
+    explicit rng(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1)
+    double uniform() {
+        return double(next() >> 11) / double(std::uint64_t(1) << 53);
+    }
+
+    // Uniform in [0, n)
+    std::uint64_t below(std::uint64_t n) {
+        return n == 0 ? 0 : next() % n;
+    }
+
+    double normal() {
+        const double pi = 3.14159265358979323846;
+        double u = 1.0 - uniform(); // in (0, 1]
+        return std::sqrt(-2.0 * std::log(u)) * std::cos(2.0 * pi * uniform());
+    }
+
+private:
+    std::uint64_t state;
+};
+
+// Part of a read taken from the genome
+struct segment {
+    std::size_t read;
+    std::uint64_t genome_begin, genome_end;
+    std::uint64_t read_offset;
+};
+
+inline std::string read_name(std::size_t read) {
+    return "read_" + std::to_string(read);
+}
+
+inline void write_fastq(const yacrd::bench::workload& w, const std::vector<std::uint64_t>& lengths, const std::string& filename) {
+    yacrd::io::writer out(filename);
+    rng gen(w.seed ^ 0xF0F0F0F0F0F0F0F0ULL);
+    std::string record;
+    for(std::size_t read = 0 ; read < lengths.size() ; read++) {
+        record = "@" + read_name(read) + "\n";
+        std::uint64_t bits = 0;
+        for(std::uint64_t i = 0 ; i < lengths[read] ; i++) {
+            if(i % 32 == 0) {
+                bits = gen.next();
+            }
+            record.push_back("ACGT"[bits & 3]);
+            bits >>= 2;
+        }
+        record += "\n+\n";
+        record.append(lengths[read], 'I');
+        record.push_back('\n');
+        out.write(record.data(), record.size());
+    }
+}
+
+} // namespace
+
+std::size_t yacrd::bench::generate(const workload& w, const std::string& prefix)
+{
+    rng gen(w.seed);
+
+    // Log-normal parameters giving the requested mean and standard deviation
+    const double mean = double(std::max<std::size_t>(w.length_mean, 1));
+    const double sigma2 = std::log(1.0 + double(w.length_sd) * double(w.length_sd) / (mean * mean));
+    const double mu = std::log(mean) - sigma2 / 2;
+    const std::uint64_t min_length = std::max<std::uint64_t>(2 * w.min_overlap, 1000);
+    const std::uint64_t max_length = std::max<std::uint64_t>(10 * w.length_mean, min_length);
+    const std::uint64_t genome_size = std::max<std::uint64_t>(std::uint64_t(double(w.nb_reads) * mean / std::max(w.depth, 0.01)), max_length);
+
+    std::vector<std::uint64_t> lengths(w.nb_reads);
+    std::vector<segment> segments;
+    for(std::size_t read = 0 ; read < w.nb_reads ; read++) {
+        double x = std::exp(mu + std::sqrt(sigma2) * gen.normal());
+        std::uint64_t len = std::min(max_length, std::max(min_length, std::uint64_t(x)));
+        lengths[read] = len;
+
+        if(gen.uniform() < w.chimera_rate) { // two unrelated parts, joined around the middle
+            std::uint64_t cut = len / 4 + gen.below(len / 2);
+            std::uint64_t first = gen.below(genome_size - cut);
+            std::uint64_t second = gen.below(genome_size - (len - cut));
+            segments.push_back(segment{read, first, first + cut, 0});
+            segments.push_back(segment{read, second, second + len - cut, cut});
+        } else {
+            std::uint64_t begin = gen.below(genome_size - len);
+            segments.push_back(segment{read, begin, begin + len, 0});
+        }
+    }
+
+    std::sort(segments.begin(), segments.end(), [](const segment& a, const segment& b) {
+        return a.genome_begin < b.genome_begin || (a.genome_begin == b.genome_begin && a.read < b.read);
+    });
+
+    yacrd::io::writer paf(prefix + ".paf");
+    yacrd::io::writer mhap(prefix + ".mhap");
+    char line[512];
+    std::size_t nb_alignments = 0;
+    for(std::size_t i = 0 ; i < segments.size() ; i++) {
+        const segment& a = segments[i];
+        for(std::size_t j = i + 1 ; j < segments.size() && segments[j].genome_begin < a.genome_end ; j++) {
+            const segment& b = segments[j];
+            const std::uint64_t end = std::min(a.genome_end, b.genome_end);
+            if(a.read == b.read || end - b.genome_begin < w.min_overlap) {
+                continue;
+            }
+
+            // Like real aligners, stop a few bases before the end of the shared region
+            const std::uint64_t clip_begin = 1 + gen.below(std::min<std::uint64_t>(50, w.min_overlap / 20));
+            const std::uint64_t clip_end = 1 + gen.below(std::min<std::uint64_t>(50, w.min_overlap / 20));
+            const std::uint64_t a_begin = a.read_offset + (b.genome_begin - a.genome_begin) + clip_begin;
+            const std::uint64_t a_end = a.read_offset + (end - a.genome_begin) - clip_end;
+            const std::uint64_t b_begin = b.read_offset + clip_begin;
+            const std::uint64_t b_end = b.read_offset + (end - b.genome_begin) - clip_end;
+            const std::uint64_t span = a_end - a_begin;
+            const char strand = gen.below(2) == 0 ? '+' : '-';
+
+            int n = std::snprintf(line, sizeof(line), "read_%zu\t%llu\t%llu\t%llu\t%c\tread_%zu\t%llu\t%llu\t%llu\t%llu\t%llu\t60\n",
+                                  a.read, (unsigned long long) lengths[a.read], (unsigned long long) a_begin, (unsigned long long) a_end, strand,
+                                  b.read, (unsigned long long) lengths[b.read], (unsigned long long) b_begin, (unsigned long long) b_end,
+                                  (unsigned long long) (span * 9 / 10), (unsigned long long) span);
+            paf.write(line, std::size_t(n));
+
+            n = std::snprintf(line, sizeof(line), "read_%zu read_%zu 0.1 %llu 0 %llu %llu %llu %d %llu %llu %llu\n",
+                              a.read, b.read, (unsigned long long) (span / 100),
+                              (unsigned long long) a_begin, (unsigned long long) a_end, (unsigned long long) lengths[a.read],
+                              strand == '+' ? 0 : 1, (unsigned long long) b_begin, (unsigned long long) b_end, (unsigned long long) lengths[b.read]);
+            mhap.write(line, std::size_t(n));
+            nb_alignments++;
+        }
+    }
+
+    write_fastq(w, lengths, prefix + ".fastq");
+
+    return nb_alignments;
+}
@@ -0,0 +1,50 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+/* standard include */
+#include <string>
+#include <cstdint>
+
+namespace yacrd {
+namespace bench {
+
+// Synthetic all-against-all mapping of reads sampled on a random genome
+struct workload {
+    std::size_t nb_reads = 10000;
+    double depth = 30;            // mean coverage of the genome
+    double chimera_rate = 0.05;   // fraction of reads made of two distant segments
+    std::size_t length_mean = 10000;
+    std::size_t length_sd = 5000; // read lengths follow a log-normal distribution
+    std::size_t min_overlap = 500;
+    std::uint64_t seed = 42;
+};
+
+// Write prefix.paf, prefix.mhap and prefix.fastq, the output only depends on w. Return the number of alignments
+std::size_t generate(const workload& w, const std::string& prefix);
+
+} // namespace bench
+} // namespace yacrd
+
+#endif // GENERATOR_HPP
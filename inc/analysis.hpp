@@ -26,15 +26,91 @@ SOFTWARE.
 /* standard include */
 #include <memory>
 #include <string>
-#include <unordered_set>
+#include <vector>
+#include <cstdint>
 
 /* project include */
+#include "stats.hpp"
 #include "utils.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+#include "sweep.hpp"
 
 namespace yacrd {
 namespace analysis {
 
-std::unordered_set<std::string> find_chimera(const std::string& paf_filename, std::uint64_t coverage_min, float coverage_ratio_min=0.8);
+struct config {
+    std::vector<std::uint64_t> coverage_mins = {0}; // reads are removed according to the first one
+    float coverage_ratio_min = 0.8;
+    unsigned nb_threads = 1;
+    yacrd::sweep::engine engine = yacrd::sweep::engine::merged;
+    std::string save_index; // write parsed intervals in this file
+    std::string load_index; // read intervals from this file instead of parsing the mapping
+    std::string report;     // write the report in this file instead of stdout, compressed if it ends with .gz or .zst
+    yacrd::report::format report_format = yacrd::report::format::text;
+    std::uint64_t max_memory = 0; // approximate budget in bytes for intervals, 0 is unlimited
+    yacrd::parser::prefilter prefilter; // alignments dropped at parse time
+    std::string state;      // merge the mapping in this state file and analyse only reads with new intervals
+    bool split = false;     // removed reads keep their covered segments, written as sub-reads by the filters
+    yacrd::stats::recorder* stats = nullptr; // collect timings and counters when set
+};
+
+// Buffers reused between the reads analysed by one thread
+struct workspace {
+    yacrd::sweep::workspace sweep;
+    std::vector<yacrd::sweep::gaps> gaps; // one per coverage threshold
+};
+
+// Set the type of a read from its gaps, return false if the read pass
+bool label_read(yacrd::report::record& r, float coverage_ratio_min);
+
+// Regions of a read of length len between its gaps, sorted and disjoint, empty if nothing is covered
+yacrd::utils::interval_vector covered_segments(const yacrd::sweep::gaps& gaps, std::uint64_t len);
+
+// Find gaps of a read for each coverage threshold and call on_flagged(const report::record&) for each
+// threshold where the read is reported. Return true if the read must be removed according to the first one.
+template<typename F>
+bool analyse_read(yacrd::utils::string_ref name, std::uint64_t len, yacrd::utils::interval* intervals_begin, yacrd::utils::interval* intervals_end, const config& cfg, workspace& ws, F&& on_flagged)
+{
+    yacrd::sweep::run(cfg.engine, intervals_begin, intervals_end, len, cfg.coverage_mins, ws.sweep, ws.gaps);
+
+    bool remove = false;
+    for(std::size_t t = 0 ; t < cfg.coverage_mins.size() ; t++)
+    {
+        yacrd::report::record r{cfg.coverage_mins[t], cfg.coverage_mins.size() > 1, yacrd::report::label::chimeric, name, len, &ws.gaps[t]};
+        bool flagged = label_read(r, cfg.coverage_ratio_min);
+        if(flagged)
+        {
+            on_flagged(r);
+        }
+        remove = remove || (t == 0 && flagged);
+    }
+
+    return remove;
+}
+
+// Reports and removed reads of one block of consecutive reads
+struct block_result {
+    std::string report;
+    std::vector<yacrd::utils::read_id> remove_reads;
+    std::vector<yacrd::utils::interval_vector> remove_segments; // covered segments of remove_reads[i] with cfg.split
+    std::vector<yacrd::utils::read_id> flagged;   // reads with report lines, in order
+    std::vector<std::size_t> report_ends;         // end of the report lines of flagged[i]
+};
+
+// Analyse all reads of read2mapping on cfg.nb_threads, results are in read order
+std::vector<block_result> analyse_blocks(yacrd::utils::read2mapping_csr& read2mapping, const config& cfg);
+
+// Same for the reads of ids only
+std::vector<block_result> analyse_blocks(yacrd::utils::read2mapping_csr& read2mapping, const config& cfg, const std::vector<yacrd::utils::read_id>& ids);
+
+// Write the report and set remove_reads, return false on an error already printed on stderr.
+// With cfg.max_memory set and a mapping too large for it, reads are analysed by partitions.
+bool find_chimera(const std::string& paf_filename, const config& cfg, yacrd::utils::read_set& remove_reads);
+
+// Same result as find_chimera but a read is reported and freed just after its last alignment,
+// a first pass over the file find this line. Reads are reported in order of last alignment.
+bool find_chimera_stream(const std::string& paf_filename, const config& cfg, yacrd::utils::read_set& remove_reads);
 
 } // namespace analysis
 } // namespace yacrd
@@ -0,0 +1,147 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+/* standard include */
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+namespace yacrd {
+namespace compression {
+
+enum class codec {
+    none,
+    gzip, // .gz, multi-member files (bgzip) are supported
+    zstd, // .zst
+};
+
+// Codec selected by the last extension of the file
+codec from_filename(const std::string& filename);
+
+// Filename without the compression extension, used to find the format of the content
+std::string strip_extension(const std::string& filename);
+
+// True if yacrd was built with support of the codec
+bool available(codec c);
+
+// Decompress a file descriptor in a dedicated thread. Blocks of complete lines are handed
+// to the reader through a bounded queue, so decompression and parsing overlap.
+class decompressor
+{
+public:
+    decompressor(int fd, codec c, std::size_t block_size);
+    ~decompressor();
+
+    decompressor(const decompressor&) = delete;
+    decompressor& operator=(const decompressor&) = delete;
+
+    // Same contract as io::line_reader::next(), the previous block is released
+    bool next(const char*& begin, const char*& end);
+
+    // True if reading or decoding the input failed, it ended early
+    bool failed() const { return error; }
+
+private:
+    static constexpr std::size_t queue_size = 4;
+
+    void run();
+    bool push(std::vector<char>& block); // return false if the reader stopped
+    std::vector<char> take_free_block();
+
+    int fd;
+    codec format;
+    std::size_t block_size;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::vector<char>> full;   // blocks ready for the reader
+    std::vector<std::vector<char>> free;  // blocks given back by the reader
+    std::vector<char> current;            // block being read
+    bool done = false;                    // set by the decoder thread at end of input
+    bool stop = false;                    // set by the reader to interrupt the decoder
+    std::atomic<bool> error{false};
+
+    std::thread worker;
+};
+
+// Compress independent blocks on worker threads, the sink receives them in order.
+// gzip blocks are BGZF blocks, so the output is also readable by htslib tools.
+class compressor
+{
+public:
+    using sink_t = std::function<void(const char*, std::size_t)>;
+
+    compressor(codec c, unsigned nb_threads, sink_t sink);
+    ~compressor();
+
+    compressor(const compressor&) = delete;
+    compressor& operator=(const compressor&) = delete;
+
+    void write(const char* data, std::size_t size);
+
+    // Compress the last block and give everything to the sink, nothing can be written after
+    void finish();
+
+    // True if a block couldn't be compressed, its data is lost
+    bool failed() const { return error; }
+
+private:
+    struct block {
+        std::vector<char> data;
+        std::vector<char> packed;
+        bool done = false;
+    };
+
+    void submit();
+    void drain(std::unique_lock<std::mutex>& lock, std::size_t limit); // give done blocks to the sink, wait while more than limit remain
+    void work();
+
+    codec format;
+    sink_t sink;
+    std::size_t block_size;
+    std::size_t max_blocks; // blocks in flight before write() waits
+    std::vector<char> current;
+    bool finished = false;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::unique_ptr<block>> blocks; // submitted blocks in output order
+    std::deque<block*> pending;                // blocks not taken by a worker
+    bool stop = false;
+    std::atomic<bool> error{false};
+
+    std::vector<std::thread> workers;
+};
+
+} // namespace compression
+} // namespace yacrd
+
+#endif // COMPRESSION_HPP
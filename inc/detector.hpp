@@ -0,0 +1,106 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef DETECTOR_HPP
+#define DETECTOR_HPP
+
+/* standard include */
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+/* project include */
+#include "utils.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+#include "analysis.hpp"
+
+namespace yacrd {
+
+// Incremental chimera detection, for programs that produce alignments themselves and link
+// libyacrd instead of writing a mapping file. Alignments are added as they come, a read is
+// analysed when it's finalized and on_flagged is called for each threshold where it's reported.
+//
+//     yacrd::detector d(cfg, [](const yacrd::report::record& r) { ... });
+//     d.add(name, len, begin, end);  // for each alignment and each of its reads
+//     d.finalize(name);              // optional, when no more alignments of this read will come
+//     d.finish();                    // analyse all other reads
+//
+// Only coverage_mins, coverage_ratio_min, engine, split and prefilter.drop_duplicates of the config are used,
+// other pre-filters apply to lines and are left to the caller.
+// The record and its name are only valid during the callback. Methods aren't thread safe.
+class detector
+{
+public:
+    using callback = std::function<void(const yacrd::report::record&)>;
+
+    detector(const yacrd::analysis::config& cfg, callback on_flagged);
+
+    // Register a read without interval, return its id
+    yacrd::utils::read_id add_read(yacrd::utils::string_ref name, std::uint64_t len);
+
+    // Add the interval [begin, end] of read covered by an alignment, begin and end can be swapped.
+    // Return the id of the read, name_index::none if coordinates don't fit on utils::coordinate.
+    yacrd::utils::read_id add(yacrd::utils::string_ref name, std::uint64_t len, std::uint64_t begin, std::uint64_t end);
+
+    // Add both reads of alignments
+    void add(const yacrd::parser::alignment& alignment);
+    void add(const yacrd::parser::alignment* begin, const yacrd::parser::alignment* end);
+
+    // Analyse the read and free its intervals, next alignments of this read are ignored.
+    // Return true if the read is removed according to the first threshold, false if it's unknown.
+    bool finalize(yacrd::utils::read_id id);
+    bool finalize(yacrd::utils::string_ref name);
+
+    // Finalize all reads not finalized yet, in order of first insertion
+    void finish();
+
+    std::size_t size() const { return read2mapping.size(); }
+    bool finalized(yacrd::utils::read_id id) const { return done[id]; }
+
+    // Largest number of intervals of a finalized read
+    std::uint64_t max_intervals() const { return max_read_intervals; }
+
+    // Intervals removed by prefilter.drop_duplicates
+    std::uint64_t duplicates() const { return nb_duplicates; }
+
+    // Removed reads, the detector is empty after this call
+    yacrd::utils::read_set release();
+
+private:
+    yacrd::analysis::config cfg;
+    callback on_flagged;
+    bool merge; // keep only the union of intervals, see sweep::union_only()
+    yacrd::analysis::workspace ws;
+
+    yacrd::utils::read2mapping_type read2mapping;
+    std::vector<bool> done;
+    std::vector<yacrd::utils::read_id> remove_ids;
+    std::vector<yacrd::utils::interval_vector> remove_segments; // covered segments of remove_ids[i] with cfg.split
+    std::uint64_t max_read_intervals = 0;
+    std::uint64_t nb_duplicates = 0;
+};
+
+} // namespace yacrd
+
+#endif // DETECTOR_HPP
@@ -25,14 +25,22 @@ SOFTWARE.
 
 /* standard include */
 #include <string>
-#include <unordered_set>
+#include <vector>
+#include <utility>
 
 /* project include */
+#include "utils.hpp"
+#include "stats.hpp"
 
 namespace yacrd {
 namespace filter {
 
-void read_write(const std::string& filter_path, const std::string& output_path, const std::unordered_set<std::string>& remove_reads);
+// Copy filter_path to output_path without the records of remove_reads, alignments are filtered on nb_threads.
+// Return false if the input can't be read completely or the output can't be written.
+bool read_write(const std::string& filter_path, const std::string& output_path, const yacrd::utils::read_set& remove_reads, unsigned nb_threads=1);
+
+// Filter each (input, output) pair concurrently, the nb_threads are shared between files and also compress .gz and .zst outputs
+bool read_write(const std::vector<std::pair<std::string, std::string>>& files, const yacrd::utils::read_set& remove_reads, unsigned nb_threads=1, yacrd::stats::recorder* stats=nullptr);
 
 } // namespace filter
 } // namespace yacrd
@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef INDEX_HPP
+#define INDEX_HPP
+
+/* standard include */
+#include <string>
+#include <cstdint>
+
+/* project include */
+#include "utils.hpp"
+#include "parser.hpp"
+
+namespace yacrd {
+namespace index {
+
+// Increment on any change of the layout or of utils::hash_name
+constexpr std::uint32_t version = 2;
+
+// Fingerprint of a mapping file: size, modification time and a hash of blocks sampled
+// along the file, so checking an index doesn't cost a read of the whole mapping
+std::uint64_t source_checksum(const std::string& filename);
+
+// Write names, lengths and intervals (sorted by read), parsed with filter, in a binary file.
+// Intervals are page aligned at the end of the file so load() can map them in place.
+bool save(const std::string& index_path, const std::string& source_path, yacrd::utils::read2mapping_csr& read2mapping, const yacrd::parser::prefilter& filter, unsigned nb_threads=1);
+
+// Return false if the index is invalid, from another version, built from another mapping file
+// or with other pre-filters than filter
+bool load(const std::string& index_path, const std::string& source_path, yacrd::utils::read2mapping_csr& read2mapping, const yacrd::parser::prefilter& filter);
+
+} // namespace index
+} // namespace yacrd
+
+#endif // INDEX_HPP
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef IO_HPP
+#define IO_HPP
+
+/* standard include */
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <vector>
+#include <cstring>
+
+/* project include */
+#include "compression.hpp"
+
+namespace yacrd {
+namespace io {
+
+// Give access to the content of a file as blocks of complete lines.
+// Regular files are memory-mapped and returned as a single block, other
+// inputs (pipes, fifo, ...) are read with large read() in a reusable buffer.
+// Files ending with .gz or .zst are decompressed by a background thread.
+class line_reader
+{
+public:
+    // With map_file false regular files are also read by blocks, so they don't count in the resident memory
+    explicit line_reader(const std::string& filename, std::size_t block_size = std::size_t(1) << 24, bool map_file = true);
+    ~line_reader();
+
+    line_reader(const line_reader&) = delete;
+    line_reader& operator=(const line_reader&) = delete;
+
+    // Set [begin, end) to the next block, return false when input is exhausted.
+    // The block end on a '\n', except for the last line of the input.
+    bool next(const char*& begin, const char*& end);
+
+    bool good() const { return fd >= 0; }
+    bool mapped() const { return map != nullptr; }
+
+    // True if the input couldn't be opened or wasn't read to its end (read or decompression
+    // error), the error is already printed. Final once next() returned false.
+    bool failed() const { return fd < 0 || read_error || (inflater != nullptr && inflater->failed()); }
+
+    // Bytes returned by next() so far
+    std::uint64_t consumed() const { return given; }
+
+private:
+    int fd = -1;
+    char* map = nullptr;
+    std::size_t map_size = 0;
+    bool eof = false;
+    bool read_error = false;
+    std::uint64_t given = 0;
+
+    std::unique_ptr<compression::decompressor> inflater;
+
+    std::vector<char> buffer;
+    std::size_t buffer_used = 0;  // bytes of valid data in the buffer
+    std::size_t buffer_given = 0; // bytes already returned by next()
+};
+
+// Write a file through a large buffer, bigger writes go directly to the file.
+// "-" is the standard output. Files ending with .gz (BGZF) or .zst are compressed
+// by nb_threads workers.
+class writer
+{
+public:
+    explicit writer(const std::string& filename, unsigned nb_threads = 1, std::size_t buffer_size = std::size_t(1) << 22);
+    ~writer();
+
+    writer(const writer&) = delete;
+    writer& operator=(const writer&) = delete;
+
+    void write(const char* data, std::size_t size);
+    void put(char c) { write(&c, 1); }
+    void flush(); // no effect on compressed output
+
+    // Write the buffer, end the compressed stream and close the file, nothing can be written after.
+    // Return false if the file couldn't be opened or any write failed. Called by the destructor.
+    bool close();
+
+    bool good() const { return !error && (packer == nullptr || !packer->failed()); }
+
+private:
+    void write_all(const char* data, std::size_t size);
+
+    int fd = -1;
+    bool owned = true; // false for the standard output
+    bool error = false;
+    bool closed = false;
+    std::vector<char> buffer;
+    std::size_t buffer_used = 0;
+
+    std::unique_ptr<compression::compressor> packer;
+};
+
+// Call f(line_begin, line_end) for each line of [begin, end), line end exclude '\n'
+template<typename F>
+inline void for_each_line(const char* begin, const char* end, F&& f)
+{
+    while(begin < end) {
+        const char* eol = static_cast<const char*>(std::memchr(begin, '\n', std::size_t(end - begin)));
+        if(eol == nullptr) {
+            eol = end;
+        }
+        f(begin, eol);
+        begin = eol + 1;
+    }
+}
+
+} // namespace io
+} // namespace yacrd
+
+#endif // IO_HPP
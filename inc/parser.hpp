@@ -25,30 +25,321 @@ SOFTWARE.
 
 /* standard include */
 #include <string>
-#include <sstream>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 /* project include */
+#include "io.hpp"
+#include "stats.hpp"
 #include "utils.hpp"
+#include "tokenizer.hpp"
 
 namespace yacrd {
 namespace parser {
 
 struct alignment_span {
-  std::string name;
+  yacrd::utils::string_ref name; // point in the parsed line
   size_t beg, end, len;
 };
 
 using alignment = std::pair<alignment_span, alignment_span>;
 
-// PAF
-void file(const std::string& filename, yacrd::utils::read2mapping_type& read2mapping);
+// Coordinates are stored on 32 bits
+inline bool fit_coordinates(const alignment& alignment) {
+    const std::uint64_t max = std::numeric_limits<yacrd::utils::coordinate>::max();
+    return alignment.first.len <= max && alignment.first.beg <= max && alignment.first.end <= max
+        && alignment.second.len <= max && alignment.second.beg <= max && alignment.second.end <= max;
+}
 
+// Alignments dropped before their intervals are stored, all disabled by default
+struct prefilter {
+    std::uint64_t min_block_length = 0; // PAF column 11, length of the first span for MHAP
+    float min_identity = 0;             // PAF matches (column 10) / block length, 1 - error for MHAP
+    std::uint64_t min_mapq = 0;         // PAF column 12, MHAP lines always pass
+    bool drop_self = false;             // both spans on the same read
+    bool drop_duplicates = false;       // identical intervals of a read are collapsed
+    bool drop_mirrors = false;          // keep only the first line of an overlap reported as A B and B A
 
-using parser_t = void (*)(std::istringstream&, alignment&, bool);
+    bool need_quality() const { return min_block_length != 0 || min_identity > 0 || min_mapq != 0; }
+    bool on_lines() const { return need_quality() || drop_self; }
+};
+
+// Fingerprint of the settings of filter, saved intervals are only valid with the same one
+std::uint64_t checksum(const prefilter& filter);
+
+struct prefilter_counts {
+    std::uint64_t short_block = 0;
+    std::uint64_t low_identity = 0;
+    std::uint64_t low_mapq = 0;
+    std::uint64_t self = 0;
+    std::uint64_t duplicates = 0; // intervals, not alignments
+    std::uint64_t mirrors = 0;
+    std::uint64_t missing_quality = 0; // quality filters set, but columns missing or malformed
+    std::uint64_t large_coordinates = 0; // lengths or positions that don't fit on utils::coordinate
+
+    prefilter_counts& operator+=(const prefilter_counts& o) {
+        short_block += o.short_block;
+        low_identity += o.low_identity;
+        low_mapq += o.low_mapq;
+        self += o.self;
+        duplicates += o.duplicates;
+        mirrors += o.mirrors;
+        missing_quality += o.missing_quality;
+        large_coordinates += o.large_coordinates;
+        return *this;
+    }
+};
+
+// Print the dropped counts on stderr and give them to stats, nothing if nothing was dropped.
+// Alignments with large coordinates aren't a pre-filter choice, they get their own warning.
+void report_dropped(const prefilter_counts& counts, yacrd::stats::recorder* stats);
+
+// PAF or MHAP, with nb_threads > 1 the blocks are split between threads.
+// With merge_intervals only the union of the intervals of each read is kept (utils::union_builder).
+// Set dropped to the number of alignments dropped by filter, return false if the file can't be read completely.
+bool file(const std::string& filename, yacrd::utils::read2mapping_csr& read2mapping, prefilter_counts& dropped, unsigned nb_threads=1, yacrd::stats::recorder* stats=nullptr, const prefilter& filter=prefilter(), bool merge_intervals=false);
+
+// Add the span interval to its read, return the read id and true if the read is new
+std::pair<yacrd::utils::read_id, bool> insert(alignment_span& span, yacrd::utils::read2mapping_type& read2mapping);
+
+
+enum class format {
+    paf,
+    mhap,
+};
+
+// Select the format from the file extension
+format file_format(const std::string& filename);
+
+// Line parsers take [begin, end) of a line without '\n', return false on a malformed line.
+// Coordinates are parsed on 64 bits, callers check fit_coordinates before storing them.
+// The format is a template parameter so the tokenizer is inlined in the parsing loops.
+template<format Format>
+bool parse_line(const char* begin, const char* end, alignment& out, bool only_names=false);
+
+template<>
+inline bool parse_line<format::paf>(const char* begin, const char* end, alignment& out, bool only_names)
+{
+    tokenizer<'\t'> tok(begin, end);
+
+    if(!tok.field(out.first.name)) { // Token 0
+        return false;
+    }
+
+    if(!only_names) {
+        if(!(tok.number(out.first.len) && tok.number(out.first.beg) && tok.number(out.first.end))) {
+            return false;
+        }
+        tok.skip(); // Token 4: skip
+    } else {
+        tok.skip(4);
+    }
+
+    if(!tok.field(out.second.name)) { // Token 5
+        return false;
+    }
+
+    if(!only_names) {
+        return tok.number(out.second.len) && tok.number(out.second.beg) && tok.number(out.second.end);
+    }
+
+    return true;
+}
+
+template<>
+inline bool parse_line<format::mhap>(const char* begin, const char* end, alignment& out, bool only_names)
+{
+    tokenizer<' '> tok(begin, end);
+
+    if(!(tok.field(out.first.name) && tok.field(out.second.name))) { // Token 0 and 1
+        return false;
+    }
+
+    if(!only_names) {
+        tok.skip(3);
+        if(!(tok.number(out.first.beg) && tok.number(out.first.end) && tok.number(out.first.len))) {
+            return false;
+        }
+
+        tok.skip();
+
+        return tok.number(out.second.beg) && tok.number(out.second.end) && tok.number(out.second.len);
+    }
+
+    return true;
+}
+
+// Columns only read by pre-filters
+struct alignment_quality {
+    std::size_t matches = 0;
+    std::size_t block_length = 0;
+    std::size_t mapq = 255;
+    float identity = 1;
+};
+
+// Parse the quality columns of a line, alignment is the result of parse_line on the same line
+template<format Format>
+bool parse_quality(const char* begin, const char* end, const alignment& align, alignment_quality& out);
+
+template<>
+inline bool parse_quality<format::paf>(const char* begin, const char* end, const alignment&, alignment_quality& out)
+{
+    tokenizer<'\t'> tok(begin, end);
+    tok.skip(9);
+    if(!(tok.number(out.matches) && tok.number(out.block_length) && tok.number(out.mapq))) {
+        return false;
+    }
+    out.identity = out.block_length != 0 ? float(out.matches) / float(out.block_length) : 0;
+    return true;
+}
+
+template<>
+inline bool parse_quality<format::mhap>(const char* begin, const char* end, const alignment& align, alignment_quality& out)
+{
+    tokenizer<' '> tok(begin, end);
+    yacrd::utils::string_ref error;
+    if(!(tok.skip(2) && tok.field(error)) || error.size == 0 || error.size >= 32) {
+        return false;
+    }
+
+    char value[32];
+    std::memcpy(value, error.data, error.size);
+    value[error.size] = '\0';
+    char* value_end;
+    out.identity = 1 - std::strtof(value, &value_end);
+    out.block_length = align.first.end > align.first.beg ? align.first.end - align.first.beg : align.first.beg - align.first.end;
+    return value_end == value + error.size;
+}
+
+// Return false and count the alignment if its coordinates don't fit on utils::coordinate
+inline bool fits(const alignment& align, prefilter_counts& counts)
+{
+    if(!fit_coordinates(align)) {
+        counts.large_coordinates++;
+        return false;
+    }
+    return true;
+}
+
+// Return false and count the reason if the line of align must be dropped
+template<format Format>
+inline bool keep(const char* begin, const char* end, const alignment& align, const prefilter& filter, prefilter_counts& counts)
+{
+    if(filter.drop_self && align.first.name == align.second.name) {
+        counts.self++;
+        return false;
+    }
+    if(!filter.need_quality()) {
+        return true;
+    }
+
+    alignment_quality quality;
+    if(!parse_quality<Format>(begin, end, align, quality)) {
+        counts.missing_quality++;
+        return false;
+    }
+    if(quality.block_length < filter.min_block_length) {
+        counts.short_block++;
+        return false;
+    }
+    if(quality.identity < filter.min_identity) {
+        counts.low_identity++;
+        return false;
+    }
+    if(quality.mapq < filter.min_mapq) {
+        counts.low_mapq++;
+        return false;
+    }
+    return true;
+}
+
+// Alignments waiting for their mirror. A line is identified by the ids of its two reads and their
+// intervals, it's stored until the same overlap comes in the other direction (B A for A B), then the
+// mirror is dropped and the line leaves the set: a mirrored overlap is stored once, and only until
+// its second line. Lines seen again in the same direction are kept, --drop-duplicates handles them.
+class mirror_set
+{
+public:
+    struct line {
+        yacrd::utils::read_id first;
+        yacrd::utils::read_id second;
+        yacrd::utils::interval first_interval;
+        yacrd::utils::interval second_interval;
+    };
+
+    // Line of align, with the ids of its reads
+    static line make(yacrd::utils::read_id first, yacrd::utils::read_id second, const alignment& align);
+
+    // Return true if l is the mirror of a stored line, which is removed, otherwise store l
+    bool match(const line& l);
+
+    std::size_t size() const { return count; }
+
+private:
+    static bool empty(const line& l) { return l.first == yacrd::utils::name_index::none; }
+    static std::uint64_t hash(const line& l); // same for a line and its mirror
+    void erase(std::size_t pos);
+    void grow();
+
+    std::size_t count = 0;
+    std::vector<line> table = std::vector<line>(16, line{yacrd::utils::name_index::none, 0, {0, 0}, {0, 0}}); // size is a power of two
+};
+
+// Runtime selected line parsers
+using parser_t = bool (*)(const char*, const char*, alignment&, bool);
+
+bool paf_line(const char* begin, const char* end, alignment& out, bool only_names=false);
+
+bool mhap_line(const char* begin, const char* end, alignment& out, bool only_names=false);
+
+// Select the line parser from the file extension
+parser_t line_parser(const std::string& filename);
+
+// Call f(alignment) for each well formed line of the reader kept by filter
+template<format Format, typename F>
+inline void for_each_alignment(yacrd::io::line_reader& reader, const prefilter& filter, prefilter_counts& counts, F&& f)
+{
+    const bool on_lines = filter.on_lines();
+    mirror_set mirrors;
+    yacrd::utils::name_index names; // ids of the lines in mirrors
+    alignment align;
+    const char* begin;
+    const char* end;
+    while(reader.next(begin, end))
+    {
+        yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+            if(line_begin != line_end && parse_line<Format>(line_begin, line_end, align, false)
+               && fits(align, counts)
+               && (!on_lines || keep<Format>(line_begin, line_end, align, filter, counts))) {
+                if(filter.drop_mirrors && mirrors.match(mirror_set::make(names.insert(align.first.name).first, names.insert(align.second.name).first, align))) {
+                    counts.mirrors++;
+                    return;
+                }
+                f(align);
+            }
+        });
+    }
+}
 
-void paf_line(std::istringstream& line, alignment& out, bool only_names=false);
+template<typename F>
+inline void for_each_alignment(yacrd::io::line_reader& reader, format fmt, const prefilter& filter, prefilter_counts& counts, F&& f)
+{
+    if(fmt == format::mhap) {
+        for_each_alignment<format::mhap>(reader, filter, counts, f);
+    } else {
+        for_each_alignment<format::paf>(reader, filter, counts, f);
+    }
+}
 
-void mhap_line(std::istringstream& line, alignment& out, bool only_names=false);
+template<typename F>
+inline void for_each_alignment(yacrd::io::line_reader& reader, format fmt, F&& f)
+{
+    prefilter_counts counts;
+    for_each_alignment(reader, fmt, prefilter(), counts, f);
+}
 
 } // namespace parser
 } // namespace yacrd
@@ -0,0 +1,54 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+/* standard include */
+#include <string>
+#include <cstdint>
+
+/* project include */
+#include "utils.hpp"
+#include "analysis.hpp"
+
+namespace yacrd {
+namespace partition {
+
+// Approximate memory used by the intervals of one alignment line, names and parsing
+// buffers included, while a mapping is loaded and analysed
+constexpr std::uint64_t bytes_per_alignment = 64;
+
+// Number of partitions needed to keep the mapping in max_memory bytes, 1 if it fits or if
+// the size of the input can't be known (pipe). Estimated from the file size and the
+// length of the first lines, compressed files are assumed to be 4 times smaller.
+unsigned count(const std::string& filename, std::uint64_t max_memory);
+
+// Same result and report as analysis::find_chimera. Alignments are spilled in nb_partitions
+// temporary files by hash of read names, in $TMPDIR or /tmp, then each partition is loaded
+// and analysed alone. Reports of partitions are merged back in order of first appearance.
+bool find_chimera(const std::string& paf_filename, const yacrd::analysis::config& cfg, unsigned nb_partitions, yacrd::utils::read_set& remove_reads);
+
+} // namespace partition
+} // namespace yacrd
+
+#endif // PARTITION_HPP
@@ -0,0 +1,81 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef REPORT_HPP
+#define REPORT_HPP
+
+/* standard include */
+#include <string>
+#include <cstdint>
+
+/* project include */
+#include "io.hpp"
+#include "utils.hpp"
+#include "sweep.hpp"
+
+namespace yacrd {
+namespace report {
+
+// text: the historical report, one line per read
+// tsv: a header line then one line per gap, every column is a single value
+// binary: one variable length record per read, fixed fields then the name and the gaps, all
+// integers little endian and no padding, see write_header and append
+enum class format {
+    text,
+    tsv,
+    binary,
+};
+
+// Return false if name isn't text, tsv or binary
+bool format_from_name(const std::string& name, format& value);
+
+enum class label : std::uint8_t {
+    chimeric = 0,
+    not_covered = 1,
+};
+
+struct record {
+    std::uint64_t coverage_min;
+    bool show_coverage; // text lines start with the threshold only if there are several
+    label type;
+    yacrd::utils::string_ref name;
+    std::uint64_t length;
+    const yacrd::sweep::gaps* gaps;
+};
+
+// Binary file start with this magic followed by a 32 bits version
+constexpr char binary_magic[8] = {'Y', 'A', 'C', 'R', 'D', 'R', 'E', 'P'};
+constexpr std::uint32_t binary_version = 1;
+
+// Append the decimal representation of value, without allocation
+void append_uint(std::string& out, std::uint64_t value);
+
+// Header of the report, nothing for text
+void write_header(format fmt, yacrd::io::writer& out);
+
+// Append the report of one read
+void append(format fmt, const record& r, std::string& out);
+
+} // namespace report
+} // namespace yacrd
+
+#endif // REPORT_HPP
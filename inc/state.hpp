@@ -0,0 +1,85 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef STATE_HPP
+#define STATE_HPP
+
+/* standard include */
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/* project include */
+#include "utils.hpp"
+#include "analysis.hpp"
+
+namespace yacrd {
+namespace state {
+
+// Increment on any change of the layout or of utils::hash_name
+constexpr std::uint32_t version = 2;
+
+// Where the intervals of one batch are in the state file
+struct batch_intervals {
+    std::uint64_t offset;                       // of the first interval
+    std::vector<yacrd::utils::read_id> ids;     // reads with intervals in the batch, in file order
+    std::vector<std::uint64_t> counts;          // number of intervals of ids[i]
+};
+
+// Reads of all mapping batches merged so far and the last verdict of each read. The state file is a
+// header followed by one record per batch, appended by each run: the new reads, the intervals of the
+// batch and the verdicts of the reads analysed again. Intervals stay in the file, a run only reads
+// the ones of the reads its batch touches.
+struct mapping_state {
+    yacrd::utils::name_index names;
+    std::vector<std::uint64_t> lengths;
+    std::vector<std::uint64_t> nb_intervals;    // of each read in all batches
+    std::vector<batch_intervals> batches;
+    std::vector<std::uint8_t> removed;          // 1 if the read is removed
+    std::vector<char> reports;                  // report lines, superseded ones included
+    std::vector<std::uint64_t> report_begin;    // last report lines of read id are reports[report_begin[id], report_end[id])
+    std::vector<std::uint64_t> report_end;
+    yacrd::utils::interval_vector covered;      // covered segments of removed reads, superseded ones included
+    std::vector<std::uint64_t> covered_begin;   // same layout as reports
+    std::vector<std::uint64_t> covered_end;
+    std::uint64_t checksum = 0;                 // config of the last batch
+    std::uint64_t size = 0;                     // bytes of the header and of the complete batches
+};
+
+// Fingerprint of the parameters that change verdicts or report lines, pre-filters included
+std::uint64_t config_checksum(const yacrd::analysis::config& cfg);
+
+// Read reads and verdicts of the state, intervals stay in the file. Return false if the state is
+// invalid, from another version or built with other pre-filters. An incomplete last batch, left
+// by an interrupted run, is ignored and replaced by the next one.
+bool load(const std::string& state_path, mapping_state& state, const yacrd::analysis::config& cfg);
+
+// Merge batch_filename in the state file cfg.state (created if it doesn't exist), analyse
+// only reads with new intervals and write the report of all reads of the state. Report and
+// removed reads are the ones of find_chimera on the concatenation of all batches.
+// Return false, without touching the file, if the existing state is rejected by load().
+bool find_chimera(const std::string& batch_filename, const yacrd::analysis::config& cfg, yacrd::utils::read_set& remove_reads);
+
+} // namespace state
+} // namespace yacrd
+
+#endif // STATE_HPP
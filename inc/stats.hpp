@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+/* standard include */
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <ostream>
+
+namespace yacrd {
+namespace stats {
+
+// CPU time of all threads of the process, user and system
+double cpu_seconds();
+
+// Peak resident set size of the process in KiB
+long peak_rss_kb();
+
+struct phase_record {
+    std::string name;
+    double wall_seconds;
+    double cpu_seconds;
+    std::uint64_t bytes;
+    std::uint64_t lines;
+};
+
+// Collect timings and counters of a run. Code receives a recorder pointer, null when
+// --stats isn't set, so disabled instrumentation is a pointer test per phase or block.
+class recorder
+{
+public:
+    explicit recorder(bool show_progress) : show_progress(show_progress) {}
+
+    // Time a phase from construction to destruction
+    class phase
+    {
+    public:
+        phase(recorder* owner, std::string name);
+        ~phase();
+
+        phase(const phase&) = delete;
+        phase& operator=(const phase&) = delete;
+
+        void count(std::uint64_t bytes, std::uint64_t lines) {
+            record.bytes += bytes;
+            record.lines += lines;
+        }
+
+    private:
+        recorder* owner;
+        phase_record record;
+        std::chrono::steady_clock::time_point wall_start;
+        double cpu_start = 0;
+    };
+
+    // Print the advance of a phase on stderr at most once per second, total is 0 if unknown
+    void progress(const char* name, std::uint64_t done, std::uint64_t total);
+
+    void mapping(std::uint64_t reads, std::uint64_t intervals, std::uint64_t max_intervals);
+
+    // Count of alignments (or intervals) dropped for a reason, added to previous ones
+    void dropped(const std::string& reason, std::uint64_t count);
+
+    // Human readable summary
+    void print(std::ostream& out) const;
+
+    // Same content as a JSON object, return false if the file can't be written
+    bool write_json(const std::string& filename) const;
+
+private:
+    bool show_progress;
+    std::mutex progress_mutex;
+    std::chrono::steady_clock::time_point last_progress;
+    bool progress_shown = false;
+
+    std::vector<phase_record> phases;
+    std::uint64_t reads = 0;
+    std::uint64_t intervals = 0;
+    std::uint64_t max_intervals = 0;
+    std::vector<std::pair<std::string, std::uint64_t>> drops;
+};
+
+} // namespace stats
+} // namespace yacrd
+
+#endif // STATS_HPP
@@ -0,0 +1,97 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef SWEEP_HPP
+#define SWEEP_HPP
+
+/* standard include */
+#include <queue>
+#include <vector>
+#include <cstdint>
+
+/* project include */
+#include "utils.hpp"
+
+namespace yacrd {
+namespace sweep {
+
+// Algorithm used to compute the coverage of a read
+enum class engine {
+    heap,   // sort intervals and keep ends of open intervals in a priority queue
+    events, // radix sort begin and end events, then one linear pass
+    merged, // with only a coverage of 0, intervals are merged while they are loaded (utils::merge_interval)
+            // and gaps are read between them; events for other thresholds or intervals not merged
+};
+
+// True if intervals can be merged when they are loaded, the gaps stay the same
+inline bool union_only(engine e, const std::vector<std::uint64_t>& coverage_mins) {
+    return e == engine::merged && coverage_mins.size() == 1 && coverage_mins[0] == 0;
+}
+
+// Low coverage regions of a read, gaps are [0, first_covered), middle_gaps and [last_covered, len)
+struct gaps {
+    std::size_t first_covered;
+    std::size_t last_covered;
+    yacrd::utils::interval_vector middle_gaps;
+};
+
+// Buffers reused between reads
+struct workspace {
+    std::priority_queue<std::size_t, std::vector<std::size_t>, std::greater<std::size_t>> stack; // interval ends
+    std::vector<yacrd::utils::coordinate> begins, ends, tmp;
+    std::vector<std::size_t> order; // thresholds indices by increasing value
+};
+
+// Find regions where coverage is lower or equal than coverage_min, intervals can be reordered
+void heap(yacrd::utils::interval* begin, yacrd::utils::interval* end, std::size_t len, std::uint64_t coverage_min, workspace& ws, gaps& out);
+
+// Same output as heap() for each value of coverage_mins, computed in one pass without sorting intervals
+void events(yacrd::utils::interval* begin, yacrd::utils::interval* end, std::size_t len, const std::vector<std::uint64_t>& coverage_mins, workspace& ws, std::vector<gaps>& out);
+
+// Same output as heap() with a coverage_min of 0 if intervals are sorted and disjoint (no interval touches the next one),
+// return false otherwise
+bool merged(const yacrd::utils::interval* begin, const yacrd::utils::interval* end, gaps& out);
+
+// out[i] are the gaps for coverage_mins[i]
+inline void run(engine e, yacrd::utils::interval* begin, yacrd::utils::interval* end, std::size_t len, const std::vector<std::uint64_t>& coverage_mins, workspace& ws, std::vector<gaps>& out) {
+    if(union_only(e, coverage_mins)) {
+        out.resize(1);
+        if(!merged(begin, end, out[0])) {
+            events(begin, end, len, coverage_mins, ws, out);
+        }
+    } else if(e == engine::heap) {
+        out.resize(coverage_mins.size());
+        for(std::size_t i = 0 ; i < coverage_mins.size() ; i++) {
+            heap(begin, end, len, coverage_mins[i], ws, out[i]);
+        }
+    } else {
+        events(begin, end, len, coverage_mins, ws, out);
+    }
+}
+
+// LSD radix sort of 32 bits values, tmp is used as buffer
+void radix_sort(std::vector<yacrd::utils::coordinate>& values, std::vector<yacrd::utils::coordinate>& tmp);
+
+} // namespace sweep
+} // namespace yacrd
+
+#endif // SWEEP_HPP
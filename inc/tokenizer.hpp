@@ -0,0 +1,177 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef TOKENIZER_HPP
+#define TOKENIZER_HPP
+
+/* standard include */
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+/* system include */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* project include */
+#include "utils.hpp"
+
+namespace yacrd {
+namespace parser {
+
+// Bit i of the mask is set if chunk[i] == Sep, chunk must have simd_width readable bytes
+#if defined(__AVX2__)
+constexpr std::ptrdiff_t simd_width = 32;
+
+template<char Sep>
+inline std::uint32_t separator_mask(const char* chunk) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(chunk));
+    return std::uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(Sep))));
+}
+#elif defined(__SSE2__)
+constexpr std::ptrdiff_t simd_width = 16;
+
+template<char Sep>
+inline std::uint32_t separator_mask(const char* chunk) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(chunk));
+    return std::uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(Sep))));
+}
+#else
+constexpr std::ptrdiff_t simd_width = 8;
+
+template<char Sep>
+inline std::uint32_t separator_mask(const char* chunk) {
+    std::uint32_t mask = 0;
+    for(std::ptrdiff_t i = 0 ; i < simd_width ; i++) {
+        mask |= std::uint32_t(chunk[i] == Sep) << i;
+    }
+    return mask;
+}
+#endif
+
+constexpr bool little_endian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+inline unsigned lowest_bit(std::uint32_t mask) {
+    return unsigned(__builtin_ctz(mask));
+}
+
+// Parse the leading digits of [begin, end), return false if it doesn't start by a digit
+// or if the value doesn't fit on out. Bytes up to readable_end can be loaded, they are ignored.
+inline bool parse_number(const char* begin, const char* end, const char* readable_end, std::size_t& out) {
+    std::size_t len = std::size_t(end - begin);
+    if(little_endian && len - 1 < 8 && readable_end - begin >= 8) {
+        // Up to 8 digits at once: check all bytes are digits, then combine pairs, quads and octets
+        std::uint64_t raw;
+        std::memcpy(&raw, begin, 8);
+        const unsigned shift = unsigned(8 - len) * 8;
+        raw <<= shift; // drop bytes after the field, leading zero bytes are '\0'
+        std::uint64_t digits = raw - (0x3030303030303030ULL << shift);
+        std::uint64_t invalid = ((raw + (0x4646464646464646ULL << shift)) | digits) & (0x8080808080808080ULL << shift);
+        if(invalid == 0) {
+            digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFULL;
+            digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFULL;
+            digits = (digits * 10000 + (digits >> 32)) & 0x00000000FFFFFFFFULL;
+            out = std::size_t(digits);
+            return true;
+        }
+    }
+
+    std::size_t val = 0;
+    const char* pos = begin;
+    for(; pos < end && *pos >= '0' && *pos <= '9' ; ++pos) {
+        const std::size_t digit = std::size_t(*pos - '0');
+        if(val > (std::numeric_limits<std::size_t>::max() - digit) / 10) {
+            return false;
+        }
+        val = val * 10 + digit;
+    }
+    out = val;
+    return pos != begin;
+}
+
+// Split a line in fields without copy. Separators are located simd_width bytes at a
+// time, the fields are then given in order by the bits of the mask.
+template<char Sep>
+class tokenizer
+{
+public:
+    tokenizer(const char* begin, const char* end) : pos(begin), end(end), scan(begin) {}
+
+    bool field(yacrd::utils::string_ref& out) {
+        if(pos > end) {
+            return false;
+        }
+        const char* sep_pos = next_separator();
+        out = yacrd::utils::string_ref(pos, std::size_t(sep_pos - pos));
+        pos = sep_pos + 1;
+        return true;
+    }
+
+    bool skip(unsigned n = 1) {
+        for(unsigned i = 0 ; i < n ; i++) {
+            if(pos > end) {
+                return false;
+            }
+            pos = next_separator() + 1;
+        }
+        return true;
+    }
+
+    bool number(std::size_t& out) {
+        if(pos > end) {
+            return false;
+        }
+        const char* field_begin = pos;
+        pos = next_separator() + 1;
+        return parse_number(field_begin, pos - 1, end, out);
+    }
+
+private:
+    // Separators of [pos, scan) are the bits of mask, relative to scan - simd_width
+    const char* next_separator() {
+        while(mask == 0) {
+            if(end - scan < simd_width) { // line tail
+                const char* sep_pos = static_cast<const char*>(std::memchr(std::max(pos, scan), Sep, std::size_t(end - std::max(pos, scan))));
+                return sep_pos == nullptr ? end : sep_pos;
+            }
+            mask = separator_mask<Sep>(scan);
+            scan += simd_width;
+        }
+        const char* sep_pos = scan - simd_width + lowest_bit(mask);
+        mask &= mask - 1;
+        return sep_pos;
+    }
+
+    const char* pos;
+    const char* end;
+    const char* scan;
+    std::uint32_t mask = 0;
+};
+
+} // namespace parser
+} // namespace yacrd
+
+#endif // TOKENIZER_HPP
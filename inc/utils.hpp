@@ -24,30 +24,384 @@ SOFTWARE.
 #define UTILS_HPP
 
 /* standard include */
+#include <algorithm>
 #include <vector>
 #include <string>
-#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <utility>
 
 namespace yacrd {
 namespace utils {
 
 // type definition
-using name_len = std::pair<std::string, std::uint64_t>;
-using interval = std::pair<std::uint64_t, std::uint64_t>;
+using read_id = std::uint32_t;
+using coordinate = std::uint32_t; // position in a read, long reads fit on 32 bits
+using interval = std::pair<coordinate, coordinate>;
 using interval_vector = std::vector<interval>;
 
-struct Read2MappingHashEq
+// Non-owning view on a name stored in a larger buffer (eg. a mapped file)
+struct string_ref
 {
-    bool operator()(const name_len& x, const name_len& y) const {
-        return x.first == y.first;
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    string_ref() = default;
+    string_ref(const char* d, std::size_t s) : data(d), size(s) {}
+
+    std::string str() const { return std::string(data, size); }
+    bool empty() const { return size == 0; }
+
+    bool operator==(const string_ref& o) const {
+        return size == o.size && std::memcmp(data, o.data, size) == 0;
+    }
+    bool operator!=(const string_ref& o) const { return !(*this == o); }
+};
+
+// Fast non-cryptographic hash of a name, read by 8 bytes words
+inline std::uint64_t hash_name(string_ref name) {
+    const std::uint64_t m = 0x9E3779B97F4A7C15ULL;
+    std::uint64_t h = name.size * m;
+    std::size_t i = 0;
+    for(; i + 8 <= name.size ; i += 8) {
+        std::uint64_t w;
+        std::memcpy(&w, name.data + i, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 29;
+    }
+    std::uint64_t w = 0;
+    std::memcpy(&w, name.data + i, name.size - i);
+    h = (h ^ w) * m;
+    return h ^ (h >> 32);
+}
+
+// Intern read names in a contiguous arena and give them dense ids in order of insertion.
+// Lookups use an open addressing table with linear probing.
+class name_index
+{
+public:
+    static constexpr read_id none = read_id(-1);
+
+    // Return the id of name, none if the name is unknown
+    read_id find(string_ref name) const;
+
+    // Return the id of name and true if it was added
+    std::pair<read_id, bool> insert(string_ref name);
+
+    // The view is invalidated by the next insert
+    string_ref name(read_id id) const {
+        return string_ref(arena.data() + offsets[id], offsets[id + 1] - offsets[id]);
+    }
+
+    std::size_t size() const { return hashes.size(); }
+
+    // Raw content, used to save and load an index without hashing names again
+    const std::vector<char>& raw_arena() const { return arena; }
+    const std::vector<std::uint64_t>& raw_offsets() const { return offsets; }
+    const std::vector<std::uint32_t>& raw_hashes() const { return hashes; }
+    void assign(std::vector<char> raw_arena, std::vector<std::uint64_t> raw_offsets, std::vector<std::uint32_t> raw_hashes);
+
+private:
+    std::size_t slot(string_ref name, std::uint32_t hash) const;
+    void grow();
+
+    std::vector<char> arena;                       // concatenated names
+    std::vector<std::uint64_t> offsets = {0};      // name of id i is arena[offsets[i], offsets[i + 1])
+    std::vector<std::uint32_t> hashes;             // hash of each name, avoid most comparisons
+    std::vector<read_id> table = std::vector<read_id>(16, none); // size is a power of two
+};
+
+// Intervals of each read, indexed by read id
+struct read2mapping_type
+{
+    name_index names;
+    std::vector<std::uint64_t> lengths;
+    std::vector<interval_vector> intervals;
+
+    // Return the id of the read, the length is the one of the first insertion
+    std::pair<read_id, bool> insert(string_ref name, std::uint64_t len) {
+        auto res = names.insert(name);
+        if(res.second) {
+            lengths.push_back(len);
+            intervals.emplace_back();
+        }
+        return res;
+    }
+
+    std::size_t size() const { return lengths.size(); }
+};
+
+// Anonymous memory mapping, backed by transparent huge pages when available.
+// Memory is zero initialised, throw std::bad_alloc on failure.
+void* huge_alloc(std::size_t bytes);
+void huge_free(void* ptr, std::size_t bytes);
+
+// Fixed size array of trivial elements allocated with huge_alloc
+template<typename T>
+class huge_array
+{
+public:
+    huge_array() = default;
+    explicit huge_array(std::size_t n) : ptr(static_cast<T*>(n ? huge_alloc(n * sizeof(T)) : nullptr)), count(n) {}
+    ~huge_array() { reset(); }
+
+    huge_array(const huge_array&) = delete;
+    huge_array& operator=(const huge_array&) = delete;
+    huge_array(huge_array&& o) : ptr(o.ptr), count(o.count) { o.ptr = nullptr; o.count = 0; }
+    huge_array& operator=(huge_array&& o) {
+        std::swap(ptr, o.ptr);
+        std::swap(count, o.count);
+        return *this;
+    }
+
+    // Take ownership of n elements in a memory mapping, released with huge_free
+    static huge_array adopt(T* mapped, std::size_t n) {
+        huge_array a;
+        a.ptr = mapped;
+        a.count = n;
+        return a;
+    }
+
+    void reset() {
+        if(ptr != nullptr) {
+            huge_free(ptr, count * sizeof(T));
+        }
+        ptr = nullptr;
+        count = 0;
+    }
+
+    T* data() { return ptr; }
+    const T* data() const { return ptr; }
+    std::size_t size() const { return count; }
+    T& operator[](std::size_t i) { return ptr[i]; }
+    const T& operator[](std::size_t i) const { return ptr[i]; }
+
+private:
+    T* ptr = nullptr;
+    std::size_t count = 0;
+};
+
+// Intervals of all reads in one arena (compressed sparse row layout),
+// intervals of read id are [offsets[id], offsets[id + 1])
+struct read2mapping_csr
+{
+    name_index names;
+    std::vector<std::uint64_t> lengths;
+    std::vector<std::uint64_t> offsets = {0};
+    huge_array<interval> intervals;
+
+    std::size_t size() const { return lengths.size(); }
+    interval* begin(read_id id) { return intervals.data() + offsets[id]; }
+    interval* end(read_id id) { return intervals.data() + offsets[id + 1]; }
+};
+
+// Build a read2mapping_csr in two phases: intervals are appended to a log of
+// (read id, interval) chunks, then counted per read and scattered in the arena.
+class csr_builder
+{
+public:
+    // Return the id of the read and true if the read is new
+    std::pair<read_id, bool> insert(string_ref name, std::uint64_t len, interval iv);
+
+    // Move reads and intervals of other after the ones of this builder
+    void append(csr_builder& other);
+
+    // For intervals inserted by pairs, the two spans of each alignment: call drop(id_a, interval_a, id_b, interval_b)
+    // on each pair in order of insertion and remove the pair if it returns true. Return the number of removed pairs.
+    template<typename F>
+    std::uint64_t remove_pairs(F drop) {
+        std::uint64_t removed = 0;
+        for(auto& chunk : log) { // pairs don't cross chunks, their size is even
+            for(std::size_t i = 0 ; i + 1 < chunk.size() ; i += 2) {
+                if(drop(chunk[i].id, chunk[i].iv, chunk[i + 1].id, chunk[i + 1].iv)) {
+                    chunk[i].id = name_index::none;
+                    chunk[i + 1].id = name_index::none;
+                    removed++;
+                }
+            }
+        }
+        return removed;
+    }
+
+    read2mapping_csr build();
+
+private:
+    struct entry {
+        read_id id;     // name_index::none if removed
+        interval iv;
+    };
+    static constexpr std::size_t chunk_size = std::size_t(1) << 20;
+
+    name_index names;
+    std::vector<std::uint64_t> lengths;
+    std::vector<std::vector<entry>> log;
+};
+
+// Add iv to the intervals of a read of length len. Intervals ending before len are kept first, sorted and
+// disjoint: iv is merged with the ones it overlaps or touches, gaps of coverage 0 only depend on their union.
+// An interval ending after len changes where the last gap starts, it's appended as it is.
+inline void merge_interval(interval_vector& intervals, interval iv, std::uint64_t len) {
+    if(iv.second > len) {
+        intervals.push_back(iv);
+        return;
+    }
+
+    auto merged_end = intervals.empty() || intervals.back().second <= len ? intervals.end() :
+        std::partition_point(intervals.begin(), intervals.end(), [len](const interval& a) { return a.second <= len; });
+    auto it = std::lower_bound(intervals.begin(), merged_end, iv.first, [](const interval& a, coordinate pos) { return a.second < pos; });
+    if(it == merged_end || it->first > iv.second) {
+        intervals.insert(it, iv);
+        return;
+    }
+
+    it->first = std::min(it->first, iv.first);
+    it->second = std::max(it->second, iv.second);
+    auto last = it + 1;
+    while(last != merged_end && last->first <= it->second) {
+        it->second = std::max(it->second, last->second);
+        ++last;
+    }
+    intervals.erase(it + 1, last);
+}
+
+// Same interface as csr_builder, but only the union of the intervals of each read is kept
+// (see merge_interval), highly covered reads end with a few intervals. Enough for gaps of coverage 0.
+class union_builder
+{
+public:
+    // Return the id of the read and true if the read is new
+    std::pair<read_id, bool> insert(string_ref name, std::uint64_t len, interval iv);
+
+    // Merge reads and intervals of other in this builder, new reads get ids after the ones of this builder
+    void append(union_builder& other);
+
+    read2mapping_csr build();
+
+private:
+    name_index names;
+    std::vector<std::uint64_t> lengths;
+    std::vector<interval_vector> intervals;
+};
+
+// A set of reads identified by id in an index of names
+class read_set
+{
+public:
+    read_set() = default;
+    explicit read_set(name_index index) : names(std::move(index)), flags(names.size(), false) {}
+
+    void insert(read_id id) { flags[id] = true; }
+
+    // The read is removed but its covered segments, sorted and disjoint, are kept as sub-reads
+    void insert(read_id id, interval_vector covered) {
+        flags[id] = true;
+        if(segments.empty()) {
+            segments.resize(flags.size());
+        }
+        segments[id] = std::move(covered);
+    }
+
+    bool contains(read_id id) const { return flags[id]; }
+    bool contains(string_ref name) const {
+        read_id id = names.find(name);
+        return id != name_index::none && flags[id];
     }
-    std::size_t operator()(const name_len& k) const
-    {
-	return std::hash<std::string>()(k.first);
+
+    // True if reads were inserted with their covered segments
+    bool has_segments() const { return !segments.empty(); }
+    const interval_vector& covered(read_id id) const { return segments[id]; }
+
+    const name_index& index() const { return names; }
+
+private:
+    name_index names;
+    std::vector<bool> flags;
+    std::vector<interval_vector> segments; // empty if no read was inserted with segments
+};
+
+// Frozen set of the names flagged in a read_set. Most looked up names are absent, they
+// are rejected by a small blocked Bloom filter that stays in cache. Table slots keep the
+// full 64 bits hash, so names are only compared on a match.
+class name_set
+{
+public:
+    name_set() = default;
+    explicit name_set(const read_set& reads);
+
+    static constexpr std::uint64_t none = std::uint64_t(-1);
+
+    // Return the index of name in the set, none if it's absent
+    std::uint64_t find(string_ref name) const {
+        const std::uint64_t hash = hash_name(name);
+        const std::uint64_t bits = bloom_bits(hash);
+        if((bloom[(hash >> 32) & (bloom.size() - 1)] & bits) != bits) {
+            return none;
+        }
+
+        const std::size_t mask = table.size() - 1;
+        for(std::size_t pos = hash & mask ; table[pos].index != empty ; pos = (pos + 1) & mask) {
+            if(table[pos].hash == hash && this->name(table[pos].index) == name) {
+                return table[pos].index;
+            }
+        }
+        return none;
     }
+
+    bool contains(string_ref name) const { return find(name) != none; }
+
+    std::size_t size() const { return offsets.size() - 1; }
+
+    // Covered segments of the read of index, the read_set had segments (read_set::has_segments)
+    bool has_segments() const { return !segment_offsets.empty(); }
+    const interval* segments_begin(std::uint64_t index) const { return segments.data() + segment_offsets[index]; }
+    const interval* segments_end(std::uint64_t index) const { return segments.data() + segment_offsets[index + 1]; }
+
+private:
+    static constexpr std::uint64_t empty = none;
+
+    struct entry {
+        std::uint64_t hash;
+        std::uint64_t index;
+    };
+
+    string_ref name(std::uint64_t index) const {
+        return string_ref(arena.data() + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+
+    static std::uint64_t bloom_bits(std::uint64_t hash) {
+        return (std::uint64_t(1) << (hash & 63)) | (std::uint64_t(1) << ((hash >> 6) & 63)) | (std::uint64_t(1) << ((hash >> 12) & 63));
+    }
+
+    std::vector<std::uint64_t> bloom = std::vector<std::uint64_t>(1, 0); // 16 bits per name, size is a power of two
+    std::vector<char> arena;
+    std::vector<std::uint64_t> offsets = {0};
+    std::vector<entry> table = std::vector<entry>(1, entry{0, empty}); // size is a power of two
+    interval_vector segments;                   // segments of index i are [segment_offsets[i], segment_offsets[i + 1])
+    std::vector<std::uint64_t> segment_offsets; // empty without segments
 };
 
-using read2mapping_type = std::unordered_map<name_len, std::vector<interval>, Read2MappingHashEq, Read2MappingHashEq>;
+// Run f(0), ..., f(nb_threads - 1) concurrently, f(0) in the calling thread
+template<typename F>
+inline void run_threads(unsigned nb_threads, F&& f) {
+  std::vector<std::thread> threads;
+  for(unsigned i = 1 ; i < nb_threads ; i++) {
+    threads.emplace_back([&f, i]() { f(i); });
+  }
+  f(0);
+  for(auto& t : threads) {
+    t.join();
+  }
+}
+
+// Sort intervals of [begin, end) and remove repeated ones, return the new end
+inline interval* collapse_duplicates(interval* begin, interval* end) {
+  std::sort(begin, end);
+  return std::unique(begin, end);
+}
+
+// Same on each read of read2mapping, intervals are compacted. Return the number of removed intervals.
+std::uint64_t collapse_duplicates(read2mapping_csr& read2mapping, unsigned nb_threads = 1);
 
 template< typename T >
 inline T absdiff( const T& lhs, const T& rhs ) {
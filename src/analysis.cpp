@@ -23,112 +23,310 @@ SOFTWARE.
 /* standard include */
 #include <memory>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <utility>
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
 #include <algorithm>
-#include <queue>
 
 /* project include */
+#include "io.hpp"
+#include "index.hpp"
 #include "parser.hpp"
+#include "report.hpp"
 #include "analysis.hpp"
+#include "detector.hpp"
+#include "partition.hpp"
+#include "state.hpp"
 
-std::unordered_set<std::string> yacrd::analysis::find_chimera(const std::string& paf_filename, std::uint64_t coverage_min, float coverage_ratio_min)
-{
-    yacrd::utils::read2mapping_type read2mapping;
-    std::unordered_set<std::string> remove_reads;
+namespace { // Local definitions
 
-    // parse paf file
-    yacrd::parser::file(std::string(paf_filename), read2mapping);
+// Number of consecutive reads analysed as one task
+constexpr std::size_t block_size = 1024;
 
-    yacrd::utils::interval_vector middle_gaps;
-    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> stack; // interval ends
+// Append the report of each flagged read to out
+struct report_appender {
+    yacrd::report::format fmt;
+    std::string& out;
 
-    // for each read
-    for(auto read_name_len : read2mapping)
-    {
-        middle_gaps.clear();
-        stack = {};
-
-        auto name_len = read_name_len.first;
-        std::string& name = name_len.first;
-        size_t len = name_len.second;
-        yacrd::utils::interval_vector& intervals = read_name_len.second;
-
-        std::sort(intervals.begin(), intervals.end());
-
-        size_t first_covered = 0;
-        size_t last_covered = 0; // end of the last sufficiently covered interval
-        for(auto interval : intervals) {
-            // Unstack intervals ending before the beginning of this one
-            while(!stack.empty() && stack.top() < interval.first) {
-                if(stack.size() > coverage_min) {
-                    last_covered = stack.top();
+    void operator()(const yacrd::report::record& r) const {
+        yacrd::report::append(fmt, r, out);
+    }
+};
+
+// Analyse nb_reads reads, the i-th one is id_of(i), in blocks dispatched dynamically between
+// threads. Results are kept in order.
+template<typename F>
+std::vector<yacrd::analysis::block_result> analyse_blocks_of(yacrd::utils::read2mapping_csr& read2mapping, const yacrd::analysis::config& cfg, std::size_t nb_reads, F id_of)
+{
+    yacrd::stats::recorder::phase phase(cfg.stats, "analysis");
+    phase.count(0, nb_reads);
+
+    std::vector<yacrd::analysis::block_result> results((nb_reads + block_size - 1) / block_size);
+    std::atomic<std::size_t> next_block(0);
+    std::atomic<std::size_t> done_blocks(0);
+    yacrd::utils::run_threads(cfg.nb_threads, [&](unsigned) {
+        yacrd::analysis::workspace ws;
+        for(std::size_t block = next_block++ ; block < results.size() ; block = next_block++)
+        {
+            yacrd::analysis::block_result& result = results[block];
+            std::size_t end = std::min(nb_reads, (block + 1) * block_size);
+            for(std::size_t i = block * block_size ; i < end ; i++)
+            {
+                yacrd::utils::read_id id = id_of(i);
+                std::size_t report_begin = result.report.size();
+                if(yacrd::analysis::analyse_read(read2mapping.names.name(id), read2mapping.lengths[id], read2mapping.begin(id), read2mapping.end(id), cfg, ws, report_appender{cfg.report_format, result.report}))
+                {
+                    result.remove_reads.push_back(id);
+                    if(cfg.split)
+                    {
+                        result.remove_segments.push_back(yacrd::analysis::covered_segments(ws.gaps[0], read2mapping.lengths[id]));
+                    }
+                }
+                if(result.report.size() != report_begin)
+                {
+                    result.flagged.push_back(id);
+                    result.report_ends.push_back(result.report.size());
                 }
-                stack.pop();
             }
 
-            // If the new interval will cross the coverage treshold
-            if(stack.size() == coverage_min) {
-                if(last_covered != 0) { // Closing a gap
-                    middle_gaps.emplace_back(last_covered, interval.first);
-                } else { // First covered region
-                    first_covered = interval.first;
-                }
+            if(cfg.stats != nullptr)
+            {
+                cfg.stats->progress("analysis", std::min(nb_reads, ++done_blocks * block_size), nb_reads);
             }
+        }
+    });
 
-            stack.push(interval.second);
+    return results;
+}
+
+} // namespace
+
+bool yacrd::analysis::label_read(yacrd::report::record& r, float coverage_ratio_min)
+{
+    // Sum first and last gap, check if the covered region is above a treshold
+    size_t uncovered_extremities = r.gaps->first_covered + (r.length - r.gaps->last_covered);
+
+    if(!r.gaps->middle_gaps.empty())
+    {   // if read have 1 or more gap it's a chimeric read
+        r.type = yacrd::report::label::chimeric;
+    } else if(uncovered_extremities > coverage_ratio_min * r.length) {
+        r.type = yacrd::report::label::not_covered;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+yacrd::utils::interval_vector yacrd::analysis::covered_segments(const yacrd::sweep::gaps& gaps, std::uint64_t len)
+{
+    // Gaps are [0, first_covered), the middle ones and [last_covered, len)
+    const std::uint64_t last = std::min<std::uint64_t>(gaps.last_covered, len);
+    std::uint64_t begin = gaps.first_covered;
+    yacrd::utils::interval_vector segments;
+    for(const auto& gap : gaps.middle_gaps)
+    {
+        if(begin < gap.first)
+        {
+            segments.emplace_back(yacrd::utils::coordinate(begin), gap.first);
         }
+        begin = gap.second;
+    }
+    if(begin < last)
+    {
+        segments.emplace_back(yacrd::utils::coordinate(begin), yacrd::utils::coordinate(last));
+    }
+    return segments;
+}
 
-        // Unstack until we reach low coverage region or the end of the read
-        while(stack.size() > coverage_min) {
-            last_covered = stack.top();
-            if(last_covered >= len) {
-                break;
-            }
-            stack.pop();
+std::vector<yacrd::analysis::block_result> yacrd::analysis::analyse_blocks(yacrd::utils::read2mapping_csr& read2mapping, const config& cfg)
+{
+    return analyse_blocks_of(read2mapping, cfg, read2mapping.size(), [](std::size_t i) { return yacrd::utils::read_id(i); });
+}
+
+std::vector<yacrd::analysis::block_result> yacrd::analysis::analyse_blocks(yacrd::utils::read2mapping_csr& read2mapping, const config& cfg, const std::vector<yacrd::utils::read_id>& ids)
+{
+    return analyse_blocks_of(read2mapping, cfg, ids.size(), [&ids](std::size_t i) { return ids[i]; });
+}
+
+bool yacrd::analysis::find_chimera(const std::string& paf_filename, const config& cfg, yacrd::utils::read_set& remove_reads)
+{
+    if(!cfg.state.empty())
+    {
+        return yacrd::state::find_chimera(paf_filename, cfg, remove_reads);
+    }
+
+    // Intervals may not fit in the memory budget, analyse reads by partitions
+    if(cfg.max_memory != 0 && cfg.load_index.empty() && cfg.save_index.empty())
+    {
+        unsigned nb_partitions = yacrd::partition::count(paf_filename, cfg.max_memory);
+        if(nb_partitions > 1)
+        {
+            return yacrd::partition::find_chimera(paf_filename, cfg, nb_partitions, remove_reads);
         }
+    }
 
-        // Sum first and last gap, check if the covered region is above a treshold
-        size_t uncovered_extremities = first_covered + (len - last_covered);
+    yacrd::utils::read2mapping_csr read2mapping;
 
-        const char* label = nullptr; // nullptr is "pass"
+    // parse paf file, or load a previously saved index
+    bool loaded = false;
+    if(!cfg.load_index.empty())
+    {
+        yacrd::stats::recorder::phase phase(cfg.stats, "index::load");
+        loaded = yacrd::index::load(cfg.load_index, paf_filename, read2mapping, cfg.prefilter);
+        if(!loaded)
+        {
+            std::cerr << "Index rejected, parse " << paf_filename << std::endl;
+        }
+    }
+    if(!loaded)
+    {
+        // A saved index must stay usable with other thresholds, and duplicates are counted before they are collapsed
+        const bool merge = yacrd::sweep::union_only(cfg.engine, cfg.coverage_mins) && cfg.save_index.empty() && !cfg.prefilter.drop_duplicates;
+        yacrd::parser::prefilter_counts dropped;
+        if(!yacrd::parser::file(paf_filename, read2mapping, dropped, cfg.nb_threads, cfg.stats, cfg.prefilter, merge))
+        {
+            return false;
+        }
+        yacrd::parser::report_dropped(dropped, cfg.stats);
+    }
 
-        if(!middle_gaps.empty())
-        {   // if read have 1 or more gap it's a chimeric read
-            label = "Chimeric\t";
-        } else if(uncovered_extremities > coverage_ratio_min * len) {
-            label = "Not_covered\t";
+    if(!cfg.save_index.empty())
+    {
+        yacrd::stats::recorder::phase phase(cfg.stats, "index::save");
+        if(!yacrd::index::save(cfg.save_index, paf_filename, read2mapping, cfg.prefilter, cfg.nb_threads))
+        {
+            return false;
         }
+    }
 
-        if(label != nullptr)
+    if(cfg.stats != nullptr)
+    {
+        std::uint64_t max_intervals = 0;
+        for(yacrd::utils::read_id id = 0 ; id < read2mapping.size() ; id++)
         {
-            remove_reads.insert(name);
-
-            size_t ngaps = size_t(first_covered != 0) + size_t(last_covered != len) + middle_gaps.size();
-            auto print_gap = [ngaps](std::pair<size_t, size_t> gap) mutable {
-                std::cout << gap.second - gap.first << "," << gap.first<< ","<< gap.second;
-                if(--ngaps > 0) {
-                    std::cout << ";";
-                } else {
-                    std::cout << "\n";
-                }
-            };
+            max_intervals = std::max<std::uint64_t>(max_intervals, read2mapping.offsets[id + 1] - read2mapping.offsets[id]);
+        }
+        cfg.stats->mapping(read2mapping.size(), read2mapping.offsets.back(), max_intervals);
+    }
+
+    auto results = analyse_blocks(read2mapping, cfg);
 
-            std::cout << label << name << "\t"<<len<<"\t";
-            if(first_covered != 0) {
-                print_gap({0, first_covered});
+    read2mapping.intervals.reset();
+    remove_reads = yacrd::utils::read_set(std::move(read2mapping.names));
+    yacrd::io::writer out(cfg.report.empty() ? "-" : cfg.report, cfg.nb_threads);
+    if(!out.good())
+    {
+        return false;
+    }
+    yacrd::report::write_header(cfg.report_format, out);
+    for(auto& result : results)
+    {
+        out.write(result.report.data(), result.report.size());
+        for(std::size_t i = 0 ; i < result.remove_reads.size() ; i++)
+        {
+            if(cfg.split)
+            {
+                remove_reads.insert(result.remove_reads[i], std::move(result.remove_segments[i]));
             }
-            for(auto gap : middle_gaps)
+            else
             {
-                print_gap(gap);
+                remove_reads.insert(result.remove_reads[i]);
             }
-            if(last_covered != len) {
-                print_gap({last_covered, len});
+        }
+        result = block_result();
+    }
+
+    return out.close();
+}
+
+bool yacrd::analysis::find_chimera_stream(const std::string& paf_filename, const config& cfg, yacrd::utils::read_set& remove_reads)
+{
+    auto format = yacrd::parser::file_format(paf_filename);
+
+    // Opened after the first pass, so the fallback can write the report itself
+    std::unique_ptr<yacrd::io::writer> out;
+    std::string report;
+    yacrd::detector detector(cfg, [&](const yacrd::report::record& r) {
+        yacrd::report::append(cfg.report_format, r, report);
+        if(report.size() >= (std::size_t(1) << 20))
+        {
+            out->write(report.data(), report.size());
+            report.clear();
+        }
+    });
+
+    // First pass: index names and find the last alignment of each read
+    std::vector<std::uint64_t> last_alignment;
+    {
+        yacrd::io::line_reader reader(paf_filename);
+        if(!reader.mapped())
+        {
+            std::cerr << "Stream mode need a regular file, fallback on default mode" << std::endl;
+            return find_chimera(paf_filename, cfg, remove_reads);
+        }
+
+        yacrd::stats::recorder::phase phase(cfg.stats, "stream::index");
+        std::uint64_t index = 0;
+        yacrd::parser::prefilter_counts ignored;
+        yacrd::parser::for_each_alignment(reader, format, cfg.prefilter, ignored, [&](yacrd::parser::alignment& alignment) {
+            for(auto* span : {&alignment.first, &alignment.second}) {
+                auto id = detector.add_read(span->name, span->len);
+                last_alignment.resize(detector.size());
+                last_alignment[id] = index;
             }
+            index++;
+        });
+        phase.count(reader.consumed(), index);
+        if(reader.failed())
+        {
+            return false;
         }
     }
 
-    return remove_reads;
+    // Second pass: analyse reads when they can't get more intervals
+    out.reset(new yacrd::io::writer(cfg.report.empty() ? "-" : cfg.report, cfg.nb_threads));
+    if(!out->good())
+    {
+        return false;
+    }
+    yacrd::report::write_header(cfg.report_format, *out);
+    yacrd::stats::recorder::phase phase(cfg.stats, "stream::analysis");
+    std::uint64_t index = 0;
+    yacrd::io::line_reader reader(paf_filename);
+    yacrd::parser::prefilter_counts dropped;
+    yacrd::parser::for_each_alignment(reader, format, cfg.prefilter, dropped, [&](yacrd::parser::alignment& alignment) {
+        auto first = detector.add(alignment.first.name, alignment.first.len, alignment.first.beg, alignment.first.end);
+        auto second = detector.add(alignment.second.name, alignment.second.len, alignment.second.beg, alignment.second.end);
+
+        if(first < last_alignment.size() && last_alignment[first] == index)
+        {
+            detector.finalize(first);
+        }
+        if(second < last_alignment.size() && last_alignment[second] == index)
+        {
+            detector.finalize(second);
+        }
+        index++;
+    });
+    if(reader.failed())
+    {
+        return false;
+    }
+
+    // Reads left if the file changed between passes
+    detector.finish();
+    dropped.duplicates = detector.duplicates();
+    yacrd::parser::report_dropped(dropped, cfg.stats);
+
+    out->write(report.data(), report.size());
+    phase.count(reader.consumed(), index);
+    if(cfg.stats != nullptr)
+    {
+        cfg.stats->mapping(detector.size(), 2 * index, detector.max_intervals());
+    }
+
+    remove_reads = detector.release();
+    return out->close();
 }
@@ -0,0 +1,611 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <memory>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+/* system include */
+#include <unistd.h>
+
+#ifdef YACRD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef YACRD_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* project include */
+#include "compression.hpp"
+
+constexpr std::size_t yacrd::compression::decompressor::queue_size;
+
+namespace { // Local definitions
+
+constexpr std::size_t input_size = std::size_t(1) << 20;
+
+// Give decompressed bytes of a file descriptor
+class source
+{
+public:
+    explicit source(int fd) : fd(fd), in(input_size) {}
+    virtual ~source() = default;
+
+    // Write up to cap bytes in out, return 0 at end of input or on error
+    virtual std::size_t fill(char* out, std::size_t cap) = 0;
+
+    // True after a read error, a decoding error or an input ending in the middle of a stream
+    bool failed() const { return error; }
+
+protected:
+    // Read more compressed input, return false at end of file
+    bool refill() {
+        while(true) {
+            ssize_t n = ::read(fd, in.data(), in.size());
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n < 0) {
+                std::cerr << "Read error: " << std::strerror(errno) << std::endl;
+                error = true;
+            }
+            in_size = n > 0 ? std::size_t(n) : 0;
+            return n > 0;
+        }
+    }
+
+    int fd;
+    std::vector<unsigned char> in;
+    std::size_t in_size = 0;
+    bool error = false;
+};
+
+#ifdef YACRD_HAVE_ZLIB
+class gzip_source : public source
+{
+public:
+    explicit gzip_source(int fd) : source(fd) {
+        std::memset(&zs, 0, sizeof(zs));
+        inflateInit2(&zs, 15 + 32); // detect gzip or zlib header
+    }
+    ~gzip_source() { inflateEnd(&zs); }
+
+    std::size_t fill(char* out, std::size_t cap) override {
+        zs.next_out = reinterpret_cast<Bytef*>(out);
+        zs.avail_out = uInt(cap);
+        while(zs.avail_out > 0 && !finished) {
+            if(zs.avail_in == 0) {
+                if(!refill()) {
+                    if(in_member && !error) {
+                        std::cerr << "Gzip decompression error: unexpected end of file" << std::endl;
+                        error = true;
+                    }
+                    finished = true;
+                    break;
+                }
+                zs.next_in = in.data();
+                zs.avail_in = uInt(in_size);
+            }
+
+            in_member = true;
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if(ret == Z_STREAM_END) { // a new member can follow (bgzip, cat of gz files)
+                inflateReset(&zs);
+                in_member = false;
+            } else if(ret != Z_OK && ret != Z_BUF_ERROR) {
+                std::cerr << "Gzip decompression error: " << (zs.msg ? zs.msg : "unknown") << std::endl;
+                error = true;
+                finished = true;
+            }
+        }
+        return cap - zs.avail_out;
+    }
+
+private:
+    z_stream zs;
+    bool finished = false;
+    bool in_member = false; // input given to the current member, which isn't complete
+};
+#endif
+
+#ifdef YACRD_HAVE_ZSTD
+class zstd_source : public source
+{
+public:
+    explicit zstd_source(int fd) : source(fd), ds(ZSTD_createDStream()) {
+        ZSTD_initDStream(ds);
+    }
+    ~zstd_source() { ZSTD_freeDStream(ds); }
+
+    std::size_t fill(char* out, std::size_t cap) override {
+        ZSTD_outBuffer output = {out, cap, 0};
+        while(output.pos < cap && !finished) {
+            if(input.pos == input.size) {
+                if(!refill()) {
+                    if(in_frame && !error) {
+                        std::cerr << "Zstd decompression error: unexpected end of file" << std::endl;
+                        error = true;
+                    }
+                    finished = true;
+                    break;
+                }
+                input = ZSTD_inBuffer{in.data(), in_size, 0};
+            }
+
+            std::size_t ret = ZSTD_decompressStream(ds, &output, &input);
+            if(ZSTD_isError(ret)) {
+                std::cerr << "Zstd decompression error: " << ZSTD_getErrorName(ret) << std::endl;
+                error = true;
+                finished = true;
+            }
+            in_frame = ret != 0; // 0 once a frame is complete
+        }
+        return output.pos;
+    }
+
+private:
+    ZSTD_DStream* ds;
+    ZSTD_inBuffer input = {nullptr, 0, 0};
+    bool finished = false;
+    bool in_frame = false;
+};
+#endif
+
+std::unique_ptr<source> make_source(int fd, yacrd::compression::codec c)
+{
+#ifdef YACRD_HAVE_ZLIB
+    if(c == yacrd::compression::codec::gzip) {
+        return std::unique_ptr<source>(new gzip_source(fd));
+    }
+#endif
+#ifdef YACRD_HAVE_ZSTD
+    if(c == yacrd::compression::codec::zstd) {
+        return std::unique_ptr<source>(new zstd_source(fd));
+    }
+#endif
+    (void) fd;
+    (void) c;
+    return nullptr;
+}
+
+// Compress one block in a self-contained unit of the codec
+class packer
+{
+public:
+    virtual ~packer() = default;
+    // Return false if the block couldn't be compressed, out is then empty
+    virtual bool pack(const std::vector<char>& in, std::vector<char>& out) = 0;
+};
+
+#ifdef YACRD_HAVE_ZLIB
+// BGZF block: a gzip member with a BC extra field holding the block size
+class bgzf_packer : public packer
+{
+public:
+    static constexpr std::size_t block_size = 0xff00; // packed block must fit in 64 KiB
+    static constexpr std::size_t header_size = 18;
+    static constexpr std::size_t footer_size = 8;
+
+    bgzf_packer() {
+        std::memset(&zs, 0, sizeof(zs));
+        initialized = deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~bgzf_packer() {
+        if(initialized) {
+            deflateEnd(&zs);
+        }
+    }
+
+    bool pack(const std::vector<char>& in, std::vector<char>& out) override {
+        if(!initialized || deflateReset(&zs) != Z_OK) {
+            std::cerr << "Gzip compression error: can't initialize zlib" << std::endl;
+            out.clear();
+            return false;
+        }
+        out.resize(header_size + deflateBound(&zs, uLong(in.size())) + footer_size);
+        zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+        zs.avail_in = uInt(in.size());
+        zs.next_out = reinterpret_cast<Bytef*>(out.data() + header_size);
+        zs.avail_out = uInt(out.size() - header_size - footer_size);
+        int ret = deflate(&zs, Z_FINISH);
+        if(ret != Z_STREAM_END) {
+            std::cerr << "Gzip compression error: " << (zs.msg != nullptr ? zs.msg : "incomplete block") << std::endl;
+            out.clear();
+            return false;
+        }
+
+        const std::size_t total = header_size + zs.total_out + footer_size;
+        const unsigned char header[header_size] = {
+            0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+            static_cast<unsigned char>((total - 1) & 0xff), static_cast<unsigned char>((total - 1) >> 8)
+        };
+        std::memcpy(out.data(), header, header_size);
+
+        const uLong crc = crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(in.data()), uInt(in.size()));
+        store_le32(out.data() + total - footer_size, std::uint32_t(crc));
+        store_le32(out.data() + total - 4, std::uint32_t(in.size()));
+        out.resize(total);
+        return true;
+    }
+
+    // Empty block marking the end of a BGZF file
+    static const std::vector<char>& eof_block() {
+        static const std::vector<char> eof = {
+            '\x1f', '\x8b', 8, 4, 0, 0, 0, 0, 0, '\xff', 6, 0, 'B', 'C', 2, 0, 0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+        };
+        return eof;
+    }
+
+private:
+    static void store_le32(char* out, std::uint32_t value) {
+        for(int i = 0 ; i < 4 ; i++) {
+            out[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+    z_stream zs;
+    bool initialized = false;
+};
+#endif
+
+#ifdef YACRD_HAVE_ZSTD
+// Each block is an independent zstd frame, frames can be concatenated
+class zstd_packer : public packer
+{
+public:
+    static constexpr std::size_t block_size = std::size_t(1) << 20;
+
+    zstd_packer() : cctx(ZSTD_createCCtx()) {}
+    ~zstd_packer() { ZSTD_freeCCtx(cctx); }
+
+    bool pack(const std::vector<char>& in, std::vector<char>& out) override {
+        if(cctx == nullptr) {
+            std::cerr << "Zstd compression error: can't create a context" << std::endl;
+            out.clear();
+            return false;
+        }
+        out.resize(ZSTD_compressBound(in.size()));
+        std::size_t size = ZSTD_compressCCtx(cctx, out.data(), out.size(), in.data(), in.size(), ZSTD_CLEVEL_DEFAULT);
+        if(ZSTD_isError(size)) {
+            std::cerr << "Zstd compression error: " << ZSTD_getErrorName(size) << std::endl;
+            out.clear();
+            return false;
+        }
+        out.resize(size);
+        return true;
+    }
+
+private:
+    ZSTD_CCtx* cctx;
+};
+#endif
+
+std::unique_ptr<packer> make_packer(yacrd::compression::codec c)
+{
+#ifdef YACRD_HAVE_ZLIB
+    if(c == yacrd::compression::codec::gzip) {
+        return std::unique_ptr<packer>(new bgzf_packer());
+    }
+#endif
+#ifdef YACRD_HAVE_ZSTD
+    if(c == yacrd::compression::codec::zstd) {
+        return std::unique_ptr<packer>(new zstd_packer());
+    }
+#endif
+    (void) c;
+    return nullptr;
+}
+
+std::size_t packer_block_size(yacrd::compression::codec c)
+{
+#ifdef YACRD_HAVE_ZSTD
+    if(c == yacrd::compression::codec::zstd) {
+        return zstd_packer::block_size;
+    }
+#endif
+#ifdef YACRD_HAVE_ZLIB
+    if(c == yacrd::compression::codec::gzip) {
+        return bgzf_packer::block_size;
+    }
+#endif
+    (void) c;
+    return std::size_t(1) << 16;
+}
+
+inline std::string extension(const std::string& filename) {
+    std::size_t dot = filename.find_last_of('.');
+    return dot == std::string::npos ? std::string() : filename.substr(dot + 1);
+}
+
+} // namespace
+
+yacrd::compression::codec yacrd::compression::from_filename(const std::string& filename)
+{
+    std::string ext = extension(filename);
+    if(ext == "gz") {
+        return codec::gzip;
+    }
+    if(ext == "zst") {
+        return codec::zstd;
+    }
+    return codec::none;
+}
+
+std::string yacrd::compression::strip_extension(const std::string& filename)
+{
+    if(from_filename(filename) == codec::none) {
+        return filename;
+    }
+    return filename.substr(0, filename.find_last_of('.'));
+}
+
+bool yacrd::compression::available(codec c)
+{
+    switch(c) {
+        case codec::none:
+            return true;
+        case codec::gzip:
+#ifdef YACRD_HAVE_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case codec::zstd:
+#ifdef YACRD_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+        default:
+            return false;
+    }
+}
+
+yacrd::compression::decompressor::decompressor(int fd, codec c, std::size_t block_size)
+    : fd(fd), format(c), block_size(block_size)
+{
+    worker = std::thread(&decompressor::run, this);
+}
+
+yacrd::compression::decompressor::~decompressor()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    worker.join();
+}
+
+bool yacrd::compression::decompressor::next(const char*& begin, const char*& end)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if(!current.empty()) {
+        free.push_back(std::move(current));
+        current.clear();
+    }
+
+    cond.wait(lock, [this]() { return !full.empty() || done; });
+    if(full.empty()) {
+        return false;
+    }
+
+    current = std::move(full.front());
+    full.pop_front();
+    lock.unlock();
+    cond.notify_all();
+
+    begin = current.data();
+    end = current.data() + current.size();
+    return true;
+}
+
+std::vector<char> yacrd::compression::decompressor::take_free_block()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if(free.empty()) {
+        return std::vector<char>();
+    }
+    std::vector<char> block = std::move(free.back());
+    free.pop_back();
+    return block;
+}
+
+bool yacrd::compression::decompressor::push(std::vector<char>& block)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this]() { return full.size() < queue_size || stop; });
+    if(stop) {
+        return false;
+    }
+    full.push_back(std::move(block));
+    lock.unlock();
+    cond.notify_all();
+    return true;
+}
+
+void yacrd::compression::decompressor::run()
+{
+    std::unique_ptr<source> src = make_source(fd, format);
+
+    std::vector<char> block = take_free_block();
+    block.resize(block_size);
+    std::size_t used = 0;
+    while(src != nullptr) {
+        std::size_t n = src->fill(block.data() + used, block.size() - used);
+        used += n;
+
+        if(n == 0) { // end of input, last line can miss its '\n'
+            error = src->failed();
+            if(used > 0) {
+                block.resize(used);
+                push(block);
+            }
+            break;
+        }
+        if(used < block.size()) {
+            continue;
+        }
+
+        // Block is full: give lines, keep the incomplete one for the next block
+        std::size_t last = used;
+        while(last > 0 && block[last - 1] != '\n') {
+            --last;
+        }
+        if(last == 0) { // a line longer than the block
+            block.resize(block.size() * 2);
+            continue;
+        }
+
+        std::vector<char> next = take_free_block();
+        next.resize(std::max(block_size, used - last));
+        std::copy(block.begin() + std::ptrdiff_t(last), block.begin() + std::ptrdiff_t(used), next.begin());
+        used -= last;
+        block.resize(last);
+        if(!push(block)) {
+            return;
+        }
+        block = std::move(next);
+    }
+
+    if(src == nullptr) {
+        error = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cond.notify_all();
+}
+
+yacrd::compression::compressor::compressor(codec c, unsigned nb_threads, sink_t sink)
+    : format(c), sink(std::move(sink)), block_size(packer_block_size(c)), max_blocks(4 * std::size_t(std::max(1u, nb_threads)))
+{
+    current.reserve(block_size);
+    for(unsigned i = 0 ; i < std::max(1u, nb_threads) ; i++) {
+        workers.emplace_back(&compressor::work, this);
+    }
+}
+
+yacrd::compression::compressor::~compressor()
+{
+    finish();
+}
+
+void yacrd::compression::compressor::write(const char* data, std::size_t size)
+{
+    while(size > 0) {
+        std::size_t n = std::min(size, block_size - current.size());
+        current.insert(current.end(), data, data + n);
+        data += n;
+        size -= n;
+        if(current.size() == block_size) {
+            submit();
+        }
+    }
+}
+
+void yacrd::compression::compressor::finish()
+{
+    if(finished) {
+        return;
+    }
+    finished = true;
+
+    if(!current.empty()) {
+        submit();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    drain(lock, 0);
+    stop = true;
+    lock.unlock();
+    cond.notify_all();
+    for(auto& worker : workers) {
+        worker.join();
+    }
+
+#ifdef YACRD_HAVE_ZLIB
+    if(format == codec::gzip) {
+        sink(bgzf_packer::eof_block().data(), bgzf_packer::eof_block().size());
+    }
+#endif
+}
+
+void yacrd::compression::compressor::submit()
+{
+    std::unique_ptr<block> b(new block());
+    b->data.swap(current);
+    current.reserve(block_size);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    pending.push_back(b.get());
+    blocks.push_back(std::move(b));
+    cond.notify_all();
+    drain(lock, max_blocks);
+}
+
+void yacrd::compression::compressor::drain(std::unique_lock<std::mutex>& lock, std::size_t limit)
+{
+    while(!blocks.empty()) {
+        if(blocks.front()->done) {
+            std::unique_ptr<block> b = std::move(blocks.front());
+            blocks.pop_front();
+            lock.unlock();
+            sink(b->packed.data(), b->packed.size());
+            lock.lock();
+            continue;
+        }
+        if(blocks.size() <= limit) {
+            return;
+        }
+        cond.wait(lock);
+    }
+}
+
+void yacrd::compression::compressor::work()
+{
+    std::unique_ptr<packer> p = make_packer(format);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while(true) {
+        cond.wait(lock, [this]() { return !pending.empty() || stop; });
+        if(pending.empty()) {
+            return;
+        }
+        block* b = pending.front();
+        pending.pop_front();
+        lock.unlock();
+
+        if(p == nullptr || !p->pack(b->data, b->packed)) {
+            error = true;
+        }
+        b->data = std::vector<char>();
+
+        lock.lock();
+        b->done = true;
+        cond.notify_all();
+    }
+}
@@ -0,0 +1,158 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+/* project include */
+#include "detector.hpp"
+
+yacrd::detector::detector(const yacrd::analysis::config& cfg, callback on_flagged)
+    : cfg(cfg), on_flagged(std::move(on_flagged)),
+      merge(yacrd::sweep::union_only(cfg.engine, cfg.coverage_mins) && !cfg.prefilter.drop_duplicates)
+{
+    // A detector only analyse, it doesn't write or collect anything itself
+    this->cfg.stats = nullptr;
+}
+
+yacrd::utils::read_id yacrd::detector::add_read(yacrd::utils::string_ref name, std::uint64_t len)
+{
+    auto res = read2mapping.insert(name, len);
+    if(res.second)
+    {
+        done.push_back(false);
+    }
+    return res.first;
+}
+
+yacrd::utils::read_id yacrd::detector::add(yacrd::utils::string_ref name, std::uint64_t len, std::uint64_t begin, std::uint64_t end)
+{
+    const std::uint64_t max = std::numeric_limits<yacrd::utils::coordinate>::max();
+    if(len > max || begin > max || end > max)
+    {
+        return yacrd::utils::name_index::none;
+    }
+
+    auto id = add_read(name, len);
+    if(!done[id])
+    {
+        auto beg = yacrd::utils::coordinate(begin);
+        auto last = yacrd::utils::coordinate(end);
+        auto iv = beg <= last ? std::make_pair(beg, last) : std::make_pair(last, beg);
+        if(merge)
+        {
+            yacrd::utils::merge_interval(read2mapping.intervals[id], iv, read2mapping.lengths[id]);
+        }
+        else
+        {
+            read2mapping.intervals[id].push_back(iv);
+        }
+    }
+    return id;
+}
+
+void yacrd::detector::add(const yacrd::parser::alignment& alignment)
+{
+    if(!yacrd::parser::fit_coordinates(alignment))
+    {
+        return;
+    }
+    add(alignment.first.name, alignment.first.len, alignment.first.beg, alignment.first.end);
+    add(alignment.second.name, alignment.second.len, alignment.second.beg, alignment.second.end);
+}
+
+void yacrd::detector::add(const yacrd::parser::alignment* begin, const yacrd::parser::alignment* end)
+{
+    for(; begin != end ; ++begin)
+    {
+        add(*begin);
+    }
+}
+
+bool yacrd::detector::finalize(yacrd::utils::read_id id)
+{
+    if(id >= read2mapping.size() || done[id])
+    {
+        return false;
+    }
+    done[id] = true;
+
+    auto& intervals = read2mapping.intervals[id];
+    if(cfg.prefilter.drop_duplicates)
+    {
+        auto end = yacrd::utils::collapse_duplicates(intervals.data(), intervals.data() + intervals.size());
+        nb_duplicates += std::uint64_t(intervals.data() + intervals.size() - end);
+        intervals.resize(std::size_t(end - intervals.data()));
+    }
+    max_read_intervals = std::max<std::uint64_t>(max_read_intervals, intervals.size());
+    bool remove = yacrd::analysis::analyse_read(read2mapping.names.name(id), read2mapping.lengths[id], intervals.data(), intervals.data() + intervals.size(), cfg, ws, on_flagged);
+    if(remove)
+    {
+        remove_ids.push_back(id);
+        if(cfg.split)
+        {
+            remove_segments.push_back(yacrd::analysis::covered_segments(ws.gaps[0], read2mapping.lengths[id]));
+        }
+    }
+    intervals = yacrd::utils::interval_vector();
+
+    return remove;
+}
+
+bool yacrd::detector::finalize(yacrd::utils::string_ref name)
+{
+    return finalize(read2mapping.names.find(name));
+}
+
+void yacrd::detector::finish()
+{
+    for(yacrd::utils::read_id id = 0 ; id < read2mapping.size() ; id++)
+    {
+        finalize(id);
+    }
+}
+
+yacrd::utils::read_set yacrd::detector::release()
+{
+    yacrd::utils::read_set remove_reads(std::move(read2mapping.names));
+    for(std::size_t i = 0 ; i < remove_ids.size() ; i++)
+    {
+        if(cfg.split)
+        {
+            remove_reads.insert(remove_ids[i], std::move(remove_segments[i]));
+        }
+        else
+        {
+            remove_reads.insert(remove_ids[i]);
+        }
+    }
+
+    read2mapping = yacrd::utils::read2mapping_type();
+    done.clear();
+    remove_ids.clear();
+    remove_segments.clear();
+    max_read_intervals = 0;
+    nb_duplicates = 0;
+    return remove_reads;
+}
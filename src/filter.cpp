@@ -21,79 +21,469 @@ SOFTWARE.
 */
 
 /* standard include */
+#include <atomic>
 #include <vector>
-#include <fstream>
-#include <sstream>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 
 /* project include */
+#include "io.hpp"
 #include "filter.hpp"
 #include "parser.hpp"
+#include "report.hpp"
 
 
 namespace { // Local definitions
 
 
-inline void filter_alignment(yacrd::parser::parser_t parser, const std::string& filter_path, const std::string& output_path, const std::unordered_set<std::string>& remove_reads)
+// Append the kept lines of [begin, end) to out, consecutive kept lines are copied at once
+template<yacrd::parser::format Format>
+inline void filter_chunk(const char* begin, const char* end, const yacrd::utils::name_set& remove_names, std::string& out)
 {
-    std::ifstream in(filter_path);
-    std::ofstream out(output_path);
-    std::string line;
-    std::istringstream line_stream;
     yacrd::parser::alignment align;
-    while(std::getline(in, line))
+    const char* run = begin;
+    yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+        if(line_begin != line_end && yacrd::parser::parse_line<Format>(line_begin, line_end, align, true)
+           && !remove_names.contains(align.first.name) && !remove_names.contains(align.second.name))
+        {
+            return;
+        }
+        out.append(run, line_begin);
+        run = std::min(line_end + 1, end);
+    });
+    out.append(run, end);
+    if(run != end && end[-1] != '\n') { // last line of the input
+        out.push_back('\n');
+    }
+}
+
+// Chunks are filtered concurrently, then written in input order
+template<yacrd::parser::format Format>
+inline bool filter_alignment(const std::string& filter_path, const std::string& output_path, const yacrd::utils::name_set& remove_names, unsigned nb_threads, std::uint64_t& bytes)
+{
+    constexpr std::ptrdiff_t chunk_size = std::ptrdiff_t(1) << 23;
+
+    yacrd::io::line_reader in(filter_path);
+    yacrd::io::writer out(output_path, nb_threads);
+    std::vector<std::string> kept(nb_threads);
+    std::vector<const char*> bounds(nb_threads + 1);
+    const char* begin;
+    const char* end;
+    while(in.next(begin, end))
     {
-        line_stream.str(line);
-        line_stream.clear();
+        while(begin < end)
+        {
+            // Next nb_threads chunks, each ending on a line end
+            bounds.front() = begin;
+            for(unsigned i = 1 ; i <= nb_threads ; i++) {
+                const char* pos = bounds[i - 1] + std::min(chunk_size, end - bounds[i - 1]);
+                const char* eol = pos < end ? static_cast<const char*>(std::memchr(pos, '\n', std::size_t(end - pos))) : nullptr;
+                bounds[i] = eol == nullptr ? end : eol + 1;
+            }
 
-        if(!line.empty()) {
-            parser(line_stream, align, true);
-            if(remove_reads.count(align.first.name) == 0 && remove_reads.count(align.second.name) == 0)
-            {
-                out<<line<<"\n";
+            yacrd::utils::run_threads(nb_threads, [&](unsigned i) {
+                kept[i].clear();
+                filter_chunk<Format>(bounds[i], bounds[i + 1], remove_names, kept[i]);
+            });
+
+            for(auto& k : kept) {
+                out.write(k.data(), k.size());
             }
+            begin = bounds.back();
         }
     }
+    bytes = in.consumed();
+    const bool written = out.close();
+    return !in.failed() && written;
 }
 
-inline void filter_fasta(const std::string& filter_path, const std::string& output_path, const std::unordered_set<std::string>& remove_reads, char header_char)
+// Write the runs of kept records of each block with one call, records can span blocks
+class run_writer
 {
+public:
+    explicit run_writer(yacrd::io::writer& out) : out(out) {}
+
+    void start_block(const char* begin) {
+        run = begin;
+    }
+
+    // A record starts at pos
+    void record(const char* pos, bool keep_record) {
+        if(keep_record == keep) {
+            return;
+        }
+        if(keep) {
+            out.write(run, std::size_t(pos - run));
+        } else {
+            run = pos;
+        }
+        keep = keep_record;
+    }
+
+    void end_block(const char* end) {
+        if(keep && end != run) {
+            out.write(run, std::size_t(end - run));
+            if(end[-1] != '\n') { // last line of the input
+                out.put('\n');
+            }
+        }
+    }
+
+private:
+    yacrd::io::writer& out;
+    const char* run = nullptr; // start of the kept bytes not yet written
     bool keep = true;
-    std::string line;
-    std::ifstream in(filter_path);
-    std::ofstream out(output_path);
-    while(std::getline(in, line))
+};
+
+// End of the header line starting at pos
+inline const char* header_end(const char* pos, const char* end)
+{
+    const char* eol = static_cast<const char*>(std::memchr(pos, '\n', std::size_t(end - pos)));
+    return eol == nullptr ? end : eol;
+}
+
+// Name of the header line starting at pos, without the header char
+inline yacrd::utils::string_ref header_name(const char* pos, const char* end)
+{
+    const char* name_end = std::find(pos + 1, header_end(pos, end), ' ');
+    return yacrd::utils::string_ref(pos + 1, std::size_t(name_end - pos - 1));
+}
+
+// Write the covered segments of a removed record as sub-reads named name_begin_end, the rest of the
+// header is kept. Sequence and quality lines are sliced where they are, FASTA segments are written as
+// the sequence comes. FASTQ sequence slices are only referenced until the quality reaches them, and
+// copied if the block holding them is released before.
+class segment_writer
+{
+public:
+    explicit segment_writer(yacrd::io::writer& out) : out(out) {}
+
+    bool active() const { return in_record; }
+
+    // Header line [begin, end) of a record, with its '>' or '@', segments are sorted and disjoint
+    void start(const char* begin, const char* end, const yacrd::utils::interval* segments_begin, const yacrd::utils::interval* segments_end) {
+        finish();
+        const char* name_end = std::find(begin + 1, end, ' ');
+        name.assign(begin, name_end);
+        rest.assign(name_end, end);
+        first = current = segments_begin;
+        last = segments_end;
+        position = 0;
+        in_record = true;
+        fastq = begin[0] == '@';
+    }
+
+    void sequence(const char* begin, const char* end) {
+        for_each_slice(begin, end, [this](std::size_t segment, const char* data, std::size_t size) {
+            if(fastq) {
+                pieces.push_back(piece{segment, data, size});
+                return;
+            }
+            if(segment != opened) {
+                open(segment);
+            }
+            out.write(data, size);
+        });
+    }
+
+    // The '+' line of a FASTQ record, quality lines follow
+    void separator() {
+        current = first;
+        position = 0;
+    }
+
+    void quality(const char* begin, const char* end) {
+        for_each_slice(begin, end, [this](std::size_t segment, const char* data, std::size_t size) {
+            if(segment != opened) {
+                open(segment);
+                for(; next_piece < pieces.size() && pieces[next_piece].segment <= segment ; next_piece++) {
+                    if(pieces[next_piece].segment == segment) {
+                        out.write(pieces[next_piece].data, pieces[next_piece].size);
+                    }
+                }
+                out.write("\n+\n", 3);
+            }
+            out.write(data, size);
+        });
+    }
+
+    // The current block is about to be released, copy the sequence slices still needed
+    void end_block() {
+        std::size_t size = 0;
+        for(std::size_t i = next_piece ; i < pieces.size() ; i++) {
+            size += pieces[i].size;
+        }
+        std::string copy;
+        copy.reserve(size);
+        for(std::size_t i = next_piece ; i < pieces.size() ; i++) {
+            copy.append(pieces[i].data, pieces[i].size);
+        }
+        owned.swap(copy);
+        const char* data = owned.data();
+        for(std::size_t i = next_piece ; i < pieces.size() ; i++) {
+            pieces[i].data = data;
+            data += pieces[i].size;
+        }
+    }
+
+    // End of the record, also called when sequence or quality are shorter than the segments
+    void finish() {
+        if(opened != none) {
+            out.put('\n');
+        }
+        opened = none;
+        pieces.clear();
+        next_piece = 0;
+        in_record = false;
+    }
+
+private:
+    static constexpr std::size_t none = std::size_t(-1);
+
+    struct piece {
+        std::size_t segment;
+        const char* data;
+        std::size_t size;
+    };
+
+    // Call f(segment index, data, size) for each part of the line [begin, end) covered by a segment
+    template<typename F>
+    void for_each_slice(const char* begin, const char* end, F f) {
+        const std::uint64_t line_end = position + std::uint64_t(end - begin);
+        while(current != last && current->second <= position) {
+            ++current;
+        }
+        for(auto segment = current ; segment != last && segment->first < line_end ; ++segment) {
+            const std::uint64_t from = std::max<std::uint64_t>(segment->first, position);
+            const std::uint64_t to = std::min<std::uint64_t>(segment->second, line_end);
+            f(std::size_t(segment - first), begin + (from - position), std::size_t(to - from));
+        }
+        position = line_end;
+    }
+
+    // Close the previous segment and write the header of this one
+    void open(std::size_t segment) {
+        if(opened != none) {
+            out.put('\n');
+        }
+        header.assign(name);
+        header.push_back('_');
+        yacrd::report::append_uint(header, first[segment].first);
+        header.push_back('_');
+        yacrd::report::append_uint(header, first[segment].second);
+        header.append(rest);
+        header.push_back('\n');
+        out.write(header.data(), header.size());
+        opened = segment;
+    }
+
+    yacrd::io::writer& out;
+    bool in_record = false;
+    bool fastq = false;
+    std::string name;   // with the header char
+    std::string rest;   // header after the name
+    std::string header;
+    const yacrd::utils::interval* first = nullptr;
+    const yacrd::utils::interval* current = nullptr; // first segment not ended before position
+    const yacrd::utils::interval* last = nullptr;
+    std::uint64_t position = 0;                      // in the sequence or quality of the record
+    std::size_t opened = none;                       // index of the segment being written
+    std::vector<piece> pieces;                       // FASTQ sequence slices, by segment
+    std::size_t next_piece = 0;
+    std::string owned;                               // pieces copied by end_block()
+};
+
+inline bool filter_fasta(const std::string& filter_path, const std::string& output_path, const yacrd::utils::name_set& remove_names, unsigned nb_threads, std::uint64_t& bytes)
+{
+    yacrd::io::line_reader in(filter_path);
+    yacrd::io::writer out(output_path, nb_threads); // compression workers
+    run_writer runs(out);
+    segment_writer split(out);
+    const char* begin;
+    const char* end;
+    while(in.next(begin, end))
     {
-        if(line[0] == header_char)
+        // '>' only appear in headers, jump from one to the next
+        runs.start_block(begin);
+        const char* body = begin; // sequence of the split record not yet sliced
+        const char* pos = begin;
+        while((pos = static_cast<const char*>(std::memchr(pos, '>', std::size_t(end - pos)))) != nullptr)
         {
-            keep = !remove_reads.count(line.substr(1, line.find_first_of(' ') - 1));
+            if(pos == begin || pos[-1] == '\n')
+            {
+                if(split.active())
+                {
+                    yacrd::io::for_each_line(body, pos, [&](const char* b, const char* e) { split.sequence(b, e); });
+                    split.finish();
+                }
+
+                const std::uint64_t index = remove_names.find(header_name(pos, end));
+                runs.record(pos, index == yacrd::utils::name_set::none);
+                if(index != yacrd::utils::name_set::none && remove_names.has_segments())
+                {
+                    const char* eol = header_end(pos, end);
+                    split.start(pos, eol, remove_names.segments_begin(index), remove_names.segments_end(index));
+                    body = eol == end ? end : eol + 1;
+                }
+            }
+            ++pos;
         }
-        if(keep)
+        if(split.active())
         {
-            out<<line<<"\n";
+            yacrd::io::for_each_line(body, end, [&](const char* b, const char* e) { split.sequence(b, e); });
         }
+        runs.end_block(end);
     }
+    split.finish();
+    bytes = in.consumed();
+    const bool written = out.close();
+    return !in.failed() && written;
 }
 
+inline bool filter_fastq(const std::string& filter_path, const std::string& output_path, const yacrd::utils::name_set& remove_names, unsigned nb_threads, std::uint64_t& bytes)
+{
+    // A record is a header, sequence lines, a '+' line and as many quality as sequence bytes,
+    // so quality lines starting by '@' aren't taken as headers
+    enum class phase {
+        header,
+        sequence,
+        quality,
+    };
+
+    yacrd::io::line_reader in(filter_path);
+    yacrd::io::writer out(output_path, nb_threads); // compression workers
+    run_writer runs(out);
+    segment_writer split(out);
+    phase state = phase::header;
+    std::size_t sequence_len = 0;
+    std::size_t quality_len = 0;
+    const char* begin;
+    const char* end;
+    while(in.next(begin, end))
+    {
+        runs.start_block(begin);
+        yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+            const std::size_t len = std::size_t(line_end - line_begin);
+            switch(state)
+            {
+                case phase::header:
+                    if(len != 0 && line_begin[0] == '@')
+                    {
+                        const std::uint64_t index = remove_names.find(header_name(line_begin, line_end));
+                        runs.record(line_begin, index == yacrd::utils::name_set::none);
+                        if(index != yacrd::utils::name_set::none && remove_names.has_segments())
+                        {
+                            split.start(line_begin, line_end, remove_names.segments_begin(index), remove_names.segments_end(index));
+                        }
+                        state = phase::sequence;
+                        sequence_len = 0;
+                    }
+                    break;
+                case phase::sequence:
+                    if(len != 0 && line_begin[0] == '+')
+                    {
+                        state = sequence_len == 0 ? phase::header : phase::quality;
+                        quality_len = 0;
+                        split.separator();
+                        if(state == phase::header)
+                        {
+                            split.finish();
+                        }
+                    }
+                    else
+                    {
+                        sequence_len += len;
+                        if(split.active())
+                        {
+                            split.sequence(line_begin, line_end);
+                        }
+                    }
+                    break;
+                case phase::quality:
+                    quality_len += len;
+                    if(split.active())
+                    {
+                        split.quality(line_begin, line_end);
+                    }
+                    if(quality_len >= sequence_len)
+                    {
+                        state = phase::header;
+                        split.finish();
+                    }
+                    break;
+                default:
+                    break;
+            }
+        });
+        split.end_block();
+        runs.end_block(end);
+    }
+    split.finish();
+    bytes = in.consumed();
+    const bool written = out.close();
+    return !in.failed() && written;
+}
 
-}  // namespace
 
-void yacrd::filter::read_write(const std::string& filter_path, const std::string& output_path, const std::unordered_set<std::string>& remove_reads)
+// Add the number of input bytes read to bytes, return false if the input or the output failed.
+// nb_threads filter alignment files and compress the output.
+inline bool filter_file(const std::string& filter_path, const std::string& output_path, const yacrd::utils::name_set& remove_names, unsigned nb_threads, std::uint64_t& bytes)
 {
-    if(filter_path.substr(filter_path.find_last_of('.') + 1) == "fasta")
+    const std::string name = yacrd::compression::strip_extension(filter_path);
+    const std::string extension = name.substr(name.find_last_of('.') + 1);
+    if(extension == "fasta")
     {
-        filter_fasta(filter_path, output_path, remove_reads, '>');
+        return filter_fasta(filter_path, output_path, remove_names, nb_threads, bytes);
     }
-    else if(filter_path.substr(filter_path.find_last_of('.') + 1) == "fastq")
+    else if(extension == "fastq")
 
     {
-        filter_fasta(filter_path, output_path, remove_reads, '@');
+        return filter_fastq(filter_path, output_path, remove_names, nb_threads, bytes);
     }
-    else if(filter_path.substr(filter_path.find_last_of('.') + 1) == "mhap")
+    else if(extension == "mhap")
     {
-        filter_alignment(yacrd::parser::mhap_line, filter_path, output_path, remove_reads);
+        return filter_alignment<yacrd::parser::format::mhap>(filter_path, output_path, remove_names, nb_threads, bytes);
     }
     else
     {
-        filter_alignment(yacrd::parser::paf_line, filter_path, output_path, remove_reads);
+        return filter_alignment<yacrd::parser::format::paf>(filter_path, output_path, remove_names, nb_threads, bytes);
+    }
+}
+
+
+}  // namespace
+
+bool yacrd::filter::read_write(const std::string& filter_path, const std::string& output_path, const yacrd::utils::read_set& remove_reads, unsigned nb_threads)
+{
+    return yacrd::filter::read_write({std::make_pair(filter_path, output_path)}, remove_reads, nb_threads);
+}
+
+bool yacrd::filter::read_write(const std::vector<std::pair<std::string, std::string>>& files, const yacrd::utils::read_set& remove_reads, unsigned nb_threads, yacrd::stats::recorder* stats)
+{
+    if(files.empty())
+    {
+        return true;
     }
+
+    yacrd::stats::recorder::phase phase(stats, "filter::read_write");
+
+    // Built once, then only read by all filters
+    const yacrd::utils::name_set remove_names(remove_reads);
+
+    // One thread per file, the others split the alignment files in chunks
+    const unsigned file_threads = std::max(1u, nb_threads / unsigned(files.size()));
+    std::atomic<std::uint64_t> bytes(0);
+    std::atomic<bool> good(true);
+    yacrd::utils::run_threads(unsigned(files.size()), [&](unsigned i) {
+        std::uint64_t file_bytes = 0;
+        if(!filter_file(files[i].first, files[i].second, remove_names, file_threads, file_bytes))
+        {
+            good = false;
+        }
+        bytes += file_bytes;
+    });
+    phase.count(bytes, 0);
+    return good;
 }
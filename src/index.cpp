@@ -0,0 +1,246 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <atomic>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <algorithm>
+
+/* system include */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* project include */
+#include "index.hpp"
+
+namespace { // Local definitions
+
+const char magic[8] = {'Y', 'A', 'C', 'R', 'D', 'I', 'D', 'X'};
+constexpr std::uint64_t page_size = 4096;
+
+struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t interval_size;
+    std::uint64_t source_checksum;
+    std::uint64_t prefilter_checksum;
+    std::uint64_t nb_reads;
+    std::uint64_t nb_intervals;
+    std::uint64_t names_size;
+};
+
+inline std::uint64_t align(std::uint64_t pos, std::uint64_t alignment) {
+    return (pos + alignment - 1) / alignment * alignment;
+}
+
+// Byte offset of each section of the file
+struct layout {
+    std::uint64_t name_offsets, hashes, lengths, interval_offsets, names, intervals, end;
+
+    explicit layout(const header& h) {
+        name_offsets = sizeof(header);
+        hashes = name_offsets + (h.nb_reads + 1) * sizeof(std::uint64_t);
+        lengths = align(hashes + h.nb_reads * sizeof(std::uint32_t), sizeof(std::uint64_t));
+        interval_offsets = lengths + h.nb_reads * sizeof(std::uint64_t);
+        names = interval_offsets + (h.nb_reads + 1) * sizeof(std::uint64_t);
+        intervals = align(names + h.names_size, page_size);
+        end = intervals + h.nb_intervals * sizeof(yacrd::utils::interval);
+    }
+};
+
+template<typename T>
+inline void write_section(std::ofstream& out, std::uint64_t pos, const T* data, std::size_t n) {
+    static const char zeros[page_size] = {0};
+    std::uint64_t current = std::uint64_t(out.tellp());
+    out.write(zeros, std::streamsize(pos - current));
+    out.write(reinterpret_cast<const char*>(data), std::streamsize(n * sizeof(T)));
+}
+
+template<typename T>
+inline std::vector<T> read_section(const char* base, std::uint64_t pos, std::size_t n) {
+    std::vector<T> values(n);
+    std::memcpy(values.data(), base + pos, n * sizeof(T));
+    return values;
+}
+
+// Offsets of a CSR section: start at 0, never decrease and end at total
+inline bool valid_offsets(const std::vector<std::uint64_t>& offsets, std::uint64_t total) {
+    if(offsets.empty() || offsets.front() != 0 || offsets.back() != total) {
+        return false;
+    }
+    return std::is_sorted(offsets.begin(), offsets.end());
+}
+
+} // namespace
+
+std::uint64_t yacrd::index::source_checksum(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if(::fstat(fd, &st) != 0) {
+        ::close(fd);
+        return 0;
+    }
+
+    const std::uint64_t m = 0x9E3779B97F4A7C15ULL;
+    std::uint64_t h = (std::uint64_t(st.st_size) * m) ^ std::uint64_t(st.st_mtime);
+
+    constexpr std::size_t nb_samples = 16;
+    constexpr std::size_t block = 1 << 16;
+    std::vector<char> buffer(block);
+    std::uint64_t size = std::uint64_t(st.st_size);
+    for(std::size_t i = 0 ; i < nb_samples ; i++) {
+        std::uint64_t offset = size > block ? (size - block) * i / (nb_samples - 1) : 0;
+        ssize_t n = ::pread(fd, buffer.data(), block, off_t(offset));
+        if(n > 0) {
+            h = (h ^ yacrd::utils::hash_name(yacrd::utils::string_ref(buffer.data(), std::size_t(n)))) * m;
+        }
+    }
+
+    ::close(fd);
+    return h;
+}
+
+bool yacrd::index::save(const std::string& index_path, const std::string& source_path, yacrd::utils::read2mapping_csr& read2mapping, const yacrd::parser::prefilter& filter, unsigned nb_threads)
+{
+    // Sort intervals of each read
+    std::atomic<std::size_t> next(0);
+    yacrd::utils::run_threads(nb_threads, [&](unsigned) {
+        for(std::size_t id = next++ ; id < read2mapping.size() ; id = next++) {
+            std::sort(read2mapping.begin(yacrd::utils::read_id(id)), read2mapping.end(yacrd::utils::read_id(id)));
+        }
+    });
+
+    const auto& names = read2mapping.names;
+    header h;
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = yacrd::index::version;
+    h.interval_size = sizeof(yacrd::utils::interval);
+    h.source_checksum = source_checksum(source_path);
+    h.prefilter_checksum = yacrd::parser::checksum(filter);
+    h.nb_reads = read2mapping.size();
+    h.nb_intervals = read2mapping.offsets.back();
+    h.names_size = names.raw_arena().size();
+    layout l(h);
+
+    std::ofstream out(index_path, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    write_section(out, l.name_offsets, names.raw_offsets().data(), names.raw_offsets().size());
+    write_section(out, l.hashes, names.raw_hashes().data(), names.raw_hashes().size());
+    write_section(out, l.lengths, read2mapping.lengths.data(), read2mapping.lengths.size());
+    write_section(out, l.interval_offsets, read2mapping.offsets.data(), read2mapping.offsets.size());
+    write_section(out, l.names, names.raw_arena().data(), names.raw_arena().size());
+    write_section(out, l.intervals, read2mapping.intervals.data(), read2mapping.intervals.size());
+
+    if(!out.flush()) { // load() rejects what was written
+        std::cerr << "Can't write index " << index_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool yacrd::index::load(const std::string& index_path, const std::string& source_path, yacrd::utils::read2mapping_csr& read2mapping, const yacrd::parser::prefilter& filter)
+{
+    int fd = ::open(index_path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "Can't open index " << index_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    header h;
+    struct stat st;
+    bool valid = ::fstat(fd, &st) == 0 && ::pread(fd, &h, sizeof(h), 0) == ssize_t(sizeof(h))
+        && std::memcmp(h.magic, magic, sizeof(magic)) == 0;
+    if(!valid) {
+        std::cerr << index_path << " isn't a yacrd index" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if(h.version != yacrd::index::version || h.interval_size != sizeof(yacrd::utils::interval)) {
+        std::cerr << "Index " << index_path << " was built by another version of yacrd" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if(h.source_checksum != source_checksum(source_path)) {
+        std::cerr << "Index " << index_path << " wasn't built from " << source_path << " or the file changed" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    if(h.prefilter_checksum != yacrd::parser::checksum(filter)) {
+        std::cerr << "Index " << index_path << " was built with other pre-filters" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    layout l(h);
+    if(std::uint64_t(st.st_size) != l.end) {
+        std::cerr << "Index " << index_path << " is truncated" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    // Private writable mapping: intervals can be reordered in place without touching the file
+    void* addr = ::mmap(nullptr, l.end, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED) {
+        std::cerr << "Can't map index " << index_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    char* base = static_cast<char*>(addr);
+
+    // Offsets index the other sections, a damaged index must not be used
+    auto name_offsets = read_section<std::uint64_t>(base, l.name_offsets, h.nb_reads + 1);
+    auto interval_offsets = read_section<std::uint64_t>(base, l.interval_offsets, h.nb_reads + 1);
+    if(!valid_offsets(name_offsets, h.names_size) || !valid_offsets(interval_offsets, h.nb_intervals)) {
+        std::cerr << "Index " << index_path << " is corrupted" << std::endl;
+        ::munmap(base, l.end);
+        return false;
+    }
+
+    read2mapping.names.assign(read_section<char>(base, l.names, h.names_size),
+                              std::move(name_offsets),
+                              read_section<std::uint32_t>(base, l.hashes, h.nb_reads));
+    read2mapping.lengths = read_section<std::uint64_t>(base, l.lengths, h.nb_reads);
+    read2mapping.offsets = std::move(interval_offsets);
+
+    // Keep only intervals mapped
+    ::munmap(base, l.intervals);
+    if(h.nb_intervals > 0) {
+        read2mapping.intervals = yacrd::utils::huge_array<yacrd::utils::interval>::adopt(
+            reinterpret_cast<yacrd::utils::interval*>(base + l.intervals), h.nb_intervals);
+    } else {
+        read2mapping.intervals.reset();
+    }
+
+    return true;
+}
@@ -0,0 +1,255 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+/* system include */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* project include */
+#include "io.hpp"
+
+yacrd::io::line_reader::line_reader(const std::string& filename, std::size_t block_size, bool map_file)
+{
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        std::cerr << "Can't open " << filename << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    compression::codec codec = compression::from_filename(filename);
+    if(codec != compression::codec::none) {
+        if(!compression::available(codec)) {
+            std::cerr << "Can't read " << filename << ": yacrd was built without support of this compression" << std::endl;
+            ::close(fd);
+            fd = -1;
+            return;
+        }
+        inflater.reset(new compression::decompressor(fd, codec, block_size));
+        return;
+    }
+
+    struct stat st;
+    if(map_file && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* addr = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(addr != MAP_FAILED) {
+            map = static_cast<char*>(addr);
+            map_size = std::size_t(st.st_size);
+            ::madvise(map, map_size, MADV_SEQUENTIAL);
+            return;
+        }
+    }
+
+    // Not mappable: fallback on buffered reads
+    buffer.resize(block_size);
+}
+
+yacrd::io::line_reader::~line_reader()
+{
+    inflater.reset(); // stop the decoder thread before closing its input
+    if(map != nullptr) {
+        ::munmap(map, map_size);
+    }
+    if(fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool yacrd::io::line_reader::next(const char*& begin, const char*& end)
+{
+    if(map != nullptr) {
+        if(eof) {
+            return false;
+        }
+        eof = true;
+        begin = map;
+        end = map + map_size;
+        given += map_size;
+        return true;
+    }
+
+    if(fd < 0) {
+        return false;
+    }
+
+    if(inflater != nullptr) {
+        if(!inflater->next(begin, end)) {
+            return false;
+        }
+        given += std::uint64_t(end - begin);
+        return true;
+    }
+
+    // Move the incomplete line left by the previous block at the buffer start
+    std::memmove(buffer.data(), buffer.data() + buffer_given, buffer_used - buffer_given);
+    buffer_used -= buffer_given;
+    buffer_given = 0;
+
+    while(true) {
+        while(!eof && buffer_used < buffer.size()) {
+            ssize_t n = ::read(fd, buffer.data() + buffer_used, buffer.size() - buffer_used);
+            if(n < 0 && errno == EINTR) {
+                continue;
+            }
+            if(n <= 0) {
+                if(n < 0) {
+                    std::cerr << "Read error: " << std::strerror(errno) << std::endl;
+                    read_error = true;
+                }
+                eof = true;
+                break;
+            }
+            buffer_used += std::size_t(n);
+        }
+
+        if(buffer_used == 0) {
+            return false;
+        }
+
+        std::size_t last = buffer_used;
+        while(last > 0 && buffer[last - 1] != '\n') {
+            --last;
+        }
+
+        if(last == 0) {
+            if(!eof) { // a line longer than the buffer
+                buffer.resize(buffer.size() * 2);
+                continue;
+            }
+            last = buffer_used;
+        }
+
+        begin = buffer.data();
+        end = buffer.data() + last;
+        buffer_given = last;
+        given += last;
+        return true;
+    }
+}
+
+yacrd::io::writer::writer(const std::string& filename, unsigned nb_threads, std::size_t buffer_size)
+{
+    if(filename == "-") {
+        fd = STDOUT_FILENO;
+        owned = false;
+    } else {
+        fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) {
+            std::cerr << "Can't open " << filename << ": " << std::strerror(errno) << std::endl;
+            error = true;
+            return;
+        }
+    }
+
+    compression::codec codec = compression::from_filename(filename);
+    if(codec != compression::codec::none) {
+        if(!compression::available(codec)) {
+            std::cerr << "Can't write " << filename << ": yacrd was built without support of this compression" << std::endl;
+            if(owned) {
+                ::close(fd);
+            }
+            fd = -1;
+            error = true;
+            return;
+        }
+        packer.reset(new compression::compressor(codec, nb_threads, [this](const char* data, std::size_t size) {
+            write_all(data, size);
+        }));
+        return;
+    }
+
+    buffer.resize(buffer_size);
+}
+
+yacrd::io::writer::~writer()
+{
+    close();
+}
+
+bool yacrd::io::writer::close()
+{
+    if(closed) {
+        return !error;
+    }
+    closed = true;
+    if(packer != nullptr) {
+        packer->finish();
+        error = error || packer->failed();
+    }
+    flush();
+    if(fd >= 0 && owned && ::close(fd) != 0) {
+        std::cerr << "Write error: " << std::strerror(errno) << std::endl;
+        error = true;
+    }
+    fd = -1;
+    return !error;
+}
+
+void yacrd::io::writer::write(const char* data, std::size_t size)
+{
+    if(packer != nullptr) {
+        packer->write(data, size);
+        return;
+    }
+    if(buffer_used + size > buffer.size()) {
+        flush();
+        if(size >= buffer.size()) {
+            write_all(data, size);
+            return;
+        }
+    }
+    std::memcpy(buffer.data() + buffer_used, data, size);
+    buffer_used += size;
+}
+
+void yacrd::io::writer::flush()
+{
+    write_all(buffer.data(), buffer_used);
+    buffer_used = 0;
+}
+
+void yacrd::io::writer::write_all(const char* data, std::size_t size)
+{
+    while(fd >= 0 && size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        if(n < 0) {
+            std::cerr << "Write error: " << std::strerror(errno) << std::endl;
+            if(owned) {
+                ::close(fd);
+            }
+            fd = -1;
+            error = true;
+            return;
+        }
+        data += n;
+        size -= std::size_t(n);
+    }
+}
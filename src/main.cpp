@@ -22,10 +22,14 @@ SOFTWARE.
 
 /* standard include */
 #include <memory>
+#include <cstdlib>
 #include <string>
 #include <utility>
+#include <vector>
 #include <iostream>
-#include <unordered_set>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
 
 /* getopt include */
 #include <getopt.h>
@@ -34,14 +38,44 @@ SOFTWARE.
 #include "utils.hpp"
 #include "parser.hpp"
 #include "filter.hpp"
+#include "report.hpp"
 #include "analysis.hpp"
+#include "stats.hpp"
 
 void print_help(void);
+bool parse_unsigned(const std::string& arg, std::uint64_t& out);
+std::vector<std::uint64_t> parse_coverage_list(const std::string& arg);
+std::uint64_t parse_memory_size(const std::string& arg);
+
+// Options without short name
+enum long_option {
+    opt_sweep = 256,
+    opt_save_index,
+    opt_load_index,
+    opt_report,
+    opt_report_format,
+    opt_max_memory,
+    opt_state,
+    opt_min_block_length,
+    opt_min_identity,
+    opt_min_mapq,
+    opt_drop_self,
+    opt_drop_duplicates,
+    opt_drop_mirrors,
+    opt_stats,
+    opt_stats_json,
+    opt_progress,
+    opt_split,
+};
 
 int main(int argc, char** argv)
 {
-    std::string paf_filename, filter, output;
-    std::uint64_t coverage_min = 0;
+    std::string paf_filename;
+    std::vector<std::string> filters, outputs;
+    yacrd::analysis::config cfg;
+    int stream = 0;
+    bool print_stats = false, show_progress = false;
+    std::string stats_json;
 
     if(argc < 3)
     {
@@ -57,11 +91,30 @@ int main(int argc, char** argv)
 	{"min_coverage", optional_argument, 0, 'c'},
 	{"filter", optional_argument, 0, 'f'},
 	{"output", optional_argument, 0, 'o'},
+	{"threads", required_argument, 0, 't'},
+	{"stream", no_argument, &stream, 1},
+	{"sweep", required_argument, 0, opt_sweep},
+	{"save-index", required_argument, 0, opt_save_index},
+	{"load-index", required_argument, 0, opt_load_index},
+	{"report", required_argument, 0, opt_report},
+	{"report-format", required_argument, 0, opt_report_format},
+	{"max-memory", required_argument, 0, opt_max_memory},
+	{"state", required_argument, 0, opt_state},
+	{"min-block-length", required_argument, 0, opt_min_block_length},
+	{"min-identity", required_argument, 0, opt_min_identity},
+	{"min-mapq", required_argument, 0, opt_min_mapq},
+	{"drop-self", no_argument, 0, opt_drop_self},
+	{"drop-duplicates", no_argument, 0, opt_drop_duplicates},
+	{"drop-mirrors", no_argument, 0, opt_drop_mirrors},
+	{"stats", no_argument, 0, opt_stats},
+	{"stats-json", required_argument, 0, opt_stats_json},
+	{"progress", no_argument, 0, opt_progress},
+	{"split", no_argument, 0, opt_split},
 	{0, 0, 0, 0}
     };
 
     int option_index = 0;
-    while((c = getopt_long(argc, argv, "hi:c:f:o:", longopts, &option_index)) != -1)
+    while((c = getopt_long(argc, argv, "hi:c:f:o:t:", longopts, &option_index)) != -1)
     {
         switch(c)
         {
@@ -79,15 +132,149 @@ int main(int argc, char** argv)
                 break;
 
 	    case 'f':
-		filter = optarg;
+		filters.push_back(optarg);
 		break;
 
 	    case 'o':
-		output = optarg;
+		outputs.push_back(optarg);
 		break;
 
             case 'c':
-                coverage_min = atol(optarg);
+                cfg.coverage_mins = parse_coverage_list(optarg);
+                if(cfg.coverage_mins.empty())
+                {
+                    std::cerr<<"Invalid coverage list "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case 't':
+            {
+                std::uint64_t nb_threads;
+                if(!parse_unsigned(optarg, nb_threads) || nb_threads > std::numeric_limits<unsigned>::max())
+                {
+                    std::cerr<<"Invalid number of threads "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                cfg.nb_threads = std::max(1u, unsigned(nb_threads));
+                break;
+            }
+
+            case opt_sweep:
+                if(std::string(optarg) == "heap")
+                {
+                    cfg.engine = yacrd::sweep::engine::heap;
+                }
+                else if(std::string(optarg) == "events")
+                {
+                    cfg.engine = yacrd::sweep::engine::events;
+                }
+                else if(std::string(optarg) == "merged")
+                {
+                    cfg.engine = yacrd::sweep::engine::merged;
+                }
+                else
+                {
+                    std::cerr<<"Unknown sweep engine "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case opt_save_index:
+                cfg.save_index = optarg;
+                break;
+
+            case opt_load_index:
+                cfg.load_index = optarg;
+                break;
+
+            case opt_report:
+                cfg.report = optarg;
+                break;
+
+            case opt_report_format:
+                if(!yacrd::report::format_from_name(optarg, cfg.report_format))
+                {
+                    std::cerr<<"Unknown report format "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case opt_max_memory:
+                cfg.max_memory = parse_memory_size(optarg);
+                if(cfg.max_memory == 0)
+                {
+                    std::cerr<<"Invalid memory size "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case opt_state:
+                cfg.state = optarg;
+                break;
+
+            case opt_min_block_length:
+                if(!parse_unsigned(optarg, cfg.prefilter.min_block_length))
+                {
+                    std::cerr<<"Invalid block length "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case opt_min_identity:
+            {
+                char* end;
+                cfg.prefilter.min_identity = std::strtof(optarg, &end);
+                if(end == optarg || *end != '\0' || !(cfg.prefilter.min_identity >= 0 && cfg.prefilter.min_identity <= 1))
+                {
+                    std::cerr<<"Identity must be between 0 and 1\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+            }
+
+            case opt_min_mapq:
+                if(!parse_unsigned(optarg, cfg.prefilter.min_mapq))
+                {
+                    std::cerr<<"Invalid mapping quality "<<optarg<<"\n"<<std::endl;
+                    print_help();
+                    return -1;
+                }
+                break;
+
+            case opt_drop_self:
+                cfg.prefilter.drop_self = true;
+                break;
+
+            case opt_drop_duplicates:
+                cfg.prefilter.drop_duplicates = true;
+                break;
+
+            case opt_drop_mirrors:
+                cfg.prefilter.drop_mirrors = true;
+                break;
+
+            case opt_stats:
+                print_stats = true;
+                break;
+
+            case opt_stats_json:
+                stats_json = optarg;
+                break;
+
+            case opt_progress:
+                show_progress = true;
+                break;
+
+            case opt_split:
+                cfg.split = true;
                 break;
 
             case 'h':
@@ -103,32 +290,182 @@ int main(int argc, char** argv)
         }
     }
 
-    if((!filter.empty() && output.empty()) || (filter.empty() && !output.empty()))
+    if(filters.size() != outputs.size())
     {
-	std::cerr<<"You need set -f,--filter and -o,--output !\n"<<std::endl;
+	std::cerr<<"You need set -f,--filter and -o,--output in pairs !\n"<<std::endl;
 	print_help();
 	return -1;
     }
 
-    std::unordered_set<std::string> remove_reads = yacrd::analysis::find_chimera(paf_filename, coverage_min);
+    if(stream && (!cfg.save_index.empty() || !cfg.load_index.empty()))
+    {
+	std::cerr<<"--stream can't be used with --save-index or --load-index\n"<<std::endl;
+	print_help();
+	return -1;
+    }
+
+    // Without any of these options instrumentation cost only a null pointer test
+    std::unique_ptr<yacrd::stats::recorder> stats;
+    if(print_stats || show_progress || !stats_json.empty())
+    {
+        stats.reset(new yacrd::stats::recorder(show_progress));
+        cfg.stats = stats.get();
+    }
+
+    if(cfg.max_memory != 0 && (stream || !cfg.save_index.empty() || !cfg.load_index.empty()))
+    {
+	std::cerr<<"--max-memory can't be used with --stream, --save-index or --load-index\n"<<std::endl;
+	print_help();
+	return -1;
+    }
 
-    if(!filter.empty() && !output.empty())
+    if(!cfg.state.empty() && (stream || cfg.max_memory != 0 || !cfg.save_index.empty() || !cfg.load_index.empty()))
     {
-	yacrd::filter::read_write(filter, output, remove_reads);
+	std::cerr<<"--state can't be used with --stream, --max-memory, --save-index or --load-index\n"<<std::endl;
+	print_help();
+	return -1;
+    }
+
+    if(!cfg.state.empty() && cfg.prefilter.drop_mirrors)
+    {
+	std::cerr<<"--drop-mirrors can't be used with --state, the two lines of an overlap can be in different batches\n"<<std::endl;
+	print_help();
+	return -1;
+    }
+
+    yacrd::utils::read_set remove_reads;
+    if(!(stream ? yacrd::analysis::find_chimera_stream(paf_filename, cfg, remove_reads) : yacrd::analysis::find_chimera(paf_filename, cfg, remove_reads)))
+    {
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string>> files;
+    for(std::size_t i = 0 ; i < filters.size() ; i++)
+    {
+        files.emplace_back(filters[i], outputs[i]);
+    }
+    if(!yacrd::filter::read_write(files, remove_reads, cfg.nb_threads, cfg.stats))
+    {
+        return 1;
+    }
+
+    if(print_stats)
+    {
+        stats->print(std::cerr);
+    }
+    if(!stats_json.empty() && !stats->write_json(stats_json))
+    {
+        return 1;
     }
 
     return 0;
 }
 
+// Decimal digits only, false if arg is empty or the value doesn't fit on 64 bits
+bool parse_unsigned(const std::string& arg, std::uint64_t& out)
+{
+    if(arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos)
+    {
+        return false;
+    }
+    try
+    {
+        out = std::stoull(arg);
+    }
+    catch(const std::out_of_range&)
+    {
+        return false;
+    }
+    return true;
+}
+
+// Comma separated list of thresholds, duplicates are ignored
+std::vector<std::uint64_t> parse_coverage_list(const std::string& arg)
+{
+    std::vector<std::uint64_t> values;
+    std::size_t pos = 0;
+    while(pos <= arg.size())
+    {
+        std::size_t comma = std::min(arg.find(',', pos), arg.size());
+        std::uint64_t c;
+        if(!parse_unsigned(arg.substr(pos, comma - pos), c))
+        {
+            return std::vector<std::uint64_t>();
+        }
+        if(std::find(values.begin(), values.end(), c) == values.end())
+        {
+            values.push_back(c);
+        }
+        pos = comma + 1;
+    }
+    return values;
+}
+
+// Number of bytes with an optional K, M or G suffix (powers of 1024), 0 if invalid
+std::uint64_t parse_memory_size(const std::string& arg)
+{
+    std::size_t digits = arg.find_first_not_of("0123456789");
+    std::uint64_t value;
+    if(!parse_unsigned(arg.substr(0, digits), value))
+    {
+        return 0;
+    }
+
+    std::string suffix = digits == std::string::npos ? std::string() : arg.substr(digits);
+    unsigned shift = 0;
+    if(suffix == "K" || suffix == "k")
+    {
+        shift = 10;
+    }
+    else if(suffix == "M" || suffix == "m")
+    {
+        shift = 20;
+    }
+    else if(suffix == "G" || suffix == "g")
+    {
+        shift = 30;
+    }
+    else if(!suffix.empty())
+    {
+        return 0;
+    }
+    return value <= (std::numeric_limits<std::uint64_t>::max() >> shift) ? value << shift : 0;
+}
+
 void print_help()
 {
-    std::cerr<<"usage: yacrd [-h] [-c coverage_min] [-f file_to_filter.(fasta|fastq|mhap|paf) -o output.(fasta|fastq|mhap|paf)]-i mapping.(paf|mhap)\n";
+    std::cerr<<"usage: yacrd [-h] [-c coverage_min[,coverage_min...]] [-t threads] [--stream] [--sweep heap|events|merged] [--save-index file.yidx|--load-index file.yidx] [--report report.txt[.gz|.zst]] [--report-format text|tsv|binary] [--max-memory size] [--state file.ystate] [--min-block-length length] [--min-identity identity] [--min-mapq mapq] [--drop-self] [--drop-duplicates] [--drop-mirrors] [--stats] [--stats-json stats.json] [--progress] [--split] [-f file_to_filter.(fasta|fastq|mhap|paf) -o output.(fasta|fastq|mhap|paf)]... -i mapping.(paf|mhap)\n";
     std::cerr<<"\n";
     std::cerr<<"options:\n";
     std::cerr<<"\t-h                   Print help message\n";
     std::cerr<<"\t-c,--min_coverage    If coverage are minus or equal to this create a gap [0]\n";
+    std::cerr<<"\t                     With a comma separated list, each report line start with its threshold and the filter use the first one\n";
+    std::cerr<<"\t-t,--threads         Number of threads used to parse and analyse mapping [1]\n";
+    std::cerr<<"\t--stream             Report and free each read after its last alignment, lower memory usage\n";
+    std::cerr<<"\t--sweep              Coverage computation, heap, events (radix sort and linear pass) or merged [merged]\n";
+    std::cerr<<"\t                     merged keeps the union of intervals of each read while parsing with -c 0, events otherwise\n";
+    std::cerr<<"\t--save-index         Save parsed mapping in a binary index\n";
+    std::cerr<<"\t--load-index         Read mapping from an index built from the -i file, instead of parsing it\n";
+    std::cerr<<"\t--report             Write the report in this file instead of the standard output\n";
+    std::cerr<<"\t--report-format      Report as text, tsv (header and one line per gap) or binary records [text]\n";
+    std::cerr<<"\t--max-memory         Approximate memory budget (with K, M or G suffix), larger mapping are analysed by partitions spilled in $TMPDIR\n";
+    std::cerr<<"\t--state              Merge the -i mapping batch in this state file (created if missing), only reads with new alignments are analysed again\n";
+    std::cerr<<"\t                     The report and the filters cover all batches merged so far\n";
+    std::cerr<<"\t--min-block-length   Ignore alignments with a shorter block (PAF column 11, first span length in MHAP) [0]\n";
+    std::cerr<<"\t--min-identity       Ignore alignments with a lower identity (PAF matches / block length, 1 - error in MHAP) [0]\n";
+    std::cerr<<"\t--min-mapq           Ignore PAF alignments with a lower mapping quality [0]\n";
+    std::cerr<<"\t--drop-self          Ignore alignments of a read against itself\n";
+    std::cerr<<"\t--drop-duplicates    Count identical intervals of a read once\n";
+    std::cerr<<"\t--drop-mirrors       Keep only the first line of an overlap reported in both directions (A B and B A) with the same coordinates\n";
+    std::cerr<<"\t                     Filters apply when the mapping is parsed, an index keeps filtered intervals\n";
+    std::cerr<<"\t--stats              Print time, throughput and memory of each phase on the error output at the end\n";
+    std::cerr<<"\t--stats-json         Write the same statistics in this JSON file\n";
+    std::cerr<<"\t--progress           Show the advance of parsing and analysis on the error output\n";
     std::cerr<<"\t-i,--in              Maping input file in PAF or MHAP format (with .paf or .mhap extension)\n";
+    std::cerr<<"\t                     Input, filtered, output and report files can be compressed with gzip (.gz, BGZF on output) or zstd (.zst)\n";
     std::cerr<<"\t-f,--filter          File contain data need to be filter (fasta|fastq|paf) output option need to be set\n";
     std::cerr<<"\t-o,--output          File where filtered data are write (fasta|fastq|paf) filter option need to be set\n";
+    std::cerr<<"\t                     -f and -o can be repeated, files are filtered concurrently and paired in order\n";
+    std::cerr<<"\t--split              Write the covered segments of removed reads in FASTA and FASTQ outputs, named read_begin_end\n";
     std::cerr<<std::endl;
 }
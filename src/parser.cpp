@@ -21,102 +21,313 @@ SOFTWARE.
 */
 
 /* standard include */
-#include <fstream>
-#include <sstream>
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <algorithm>
 #include <limits>
 
 /* project include */
+#include "io.hpp"
 #include "parser.hpp"
 
 namespace  {
 
-inline bool insert(yacrd::parser::alignment_span& span, yacrd::utils::read2mapping_type& read2mapping) {
-    if(span.beg > span.end) {
-        std::swap(span.beg, span.end);
-    }
+// Interval of the span on its read, begin and end ordered
+inline yacrd::utils::interval span_interval(const yacrd::parser::alignment_span& span) {
+    auto beg = yacrd::utils::coordinate(span.beg);
+    auto end = yacrd::utils::coordinate(span.end);
+    return beg <= end ? std::make_pair(beg, end) : std::make_pair(end, beg);
+}
 
-    // Inserts a new vector in the map, if the read wasn't already indexed
-    auto res = read2mapping.emplace(std::make_pair(span.name, span.len), yacrd::utils::interval_vector());
-    auto it = res.first; // Map iterator at the preexistent or inserted entry
-    it->second.push_back(std::make_pair(span.beg, span.end));
+template<typename Builder>
+inline void insert_alignment(const yacrd::parser::alignment& alignment, Builder& builder) {
+    builder.insert(alignment.first.name, alignment.first.len, span_interval(alignment.first));
+    builder.insert(alignment.second.name, alignment.second.len, span_interval(alignment.second));
+}
 
-    return res.second;
+// Insert alignments of well formed lines kept by filter, return the number of non empty lines
+template<yacrd::parser::format Format, typename Builder>
+inline std::uint64_t parse_block(const char* begin, const char* end, Builder& out, const yacrd::parser::prefilter& filter, yacrd::parser::prefilter_counts& counts) {
+    const bool on_lines = filter.on_lines();
+    yacrd::parser::alignment alignment;
+    std::uint64_t lines = 0;
+    yacrd::io::for_each_line(begin, end, [&](const char* line_begin, const char* line_end) {
+        lines += line_begin != line_end;
+        if(line_begin != line_end && yacrd::parser::parse_line<Format>(line_begin, line_end, alignment, false)
+           && yacrd::parser::fits(alignment, counts)
+           && (!on_lines || yacrd::parser::keep<Format>(line_begin, line_end, alignment, filter, counts))) {
+            insert_alignment(alignment, out);
+        }
+    });
+    return lines;
 }
 
-inline bool insert(yacrd::parser::alignment& alignment, yacrd::utils::read2mapping_type& read2mapping) {
-    bool ins_first = insert(alignment.first, read2mapping);
-    bool ins_second = insert(alignment.second, read2mapping);
-    return ins_first || ins_second;
+// Remove the second line of mirrored overlaps, the log of builder is in file order whatever the threads
+inline std::uint64_t drop_mirrors(yacrd::utils::csr_builder& builder) {
+    yacrd::parser::mirror_set mirrors;
+    return builder.remove_pairs([&mirrors](yacrd::utils::read_id a, yacrd::utils::interval a_interval, yacrd::utils::read_id b, yacrd::utils::interval b_interval) {
+        return mirrors.match(yacrd::parser::mirror_set::line{a, b, a_interval, b_interval});
+    });
 }
 
-} // namespace
+// file() uses a csr_builder when mirrors are dropped
+inline std::uint64_t drop_mirrors(yacrd::utils::union_builder&) {
+    return 0;
+}
 
-void yacrd::parser::file(const std::string& filename, yacrd::utils::read2mapping_type& read2mapping)
-{
-    auto parse_line = yacrd::parser::paf_line;
-    if(filename.substr(filename.find_last_of('.') + 1) == "mhap")
-    {
-        parse_line = yacrd::parser::mhap_line;
-    }
+// Builder is utils::csr_builder or utils::union_builder
+template<yacrd::parser::format Format, typename Builder>
+bool parse_file(const std::string& filename, yacrd::utils::read2mapping_csr& read2mapping, yacrd::parser::prefilter_counts& dropped, unsigned nb_threads, yacrd::stats::recorder* stats, const yacrd::parser::prefilter& filter) {
+    constexpr std::ptrdiff_t slice_size = std::ptrdiff_t(1) << 26;
 
-    std::ifstream infile(filename);
-    std::string line;
-    std::istringstream line_stream;
-    yacrd::parser::alignment alignment;
-    while(std::getline(infile, line))
+    yacrd::stats::recorder::phase phase(stats, "parser::file");
+    yacrd::io::line_reader reader(filename);
+    Builder builder;
+
+    const char* begin;
+    const char* end;
+    std::vector<Builder> shards(nb_threads);
+    std::vector<yacrd::parser::prefilter_counts> counts(nb_threads);
+    std::vector<const char*> bounds(nb_threads + 1);
+    std::vector<std::uint64_t> shard_lines(nb_threads);
+    std::uint64_t done = 0;
+    std::uint64_t lines = 0;
+    while(reader.next(begin, end))
     {
-        if(!line.empty()) {
-            line_stream.str(line);
-            line_stream.clear();
+        const std::uint64_t total = reader.mapped() ? std::uint64_t(end - begin) : 0;
+        while(begin < end)
+        {
+            // Next slice of each thread, ending on a line end
+            bounds.front() = begin;
+            for(unsigned i = 1 ; i <= nb_threads ; i++) {
+                const char* pos = bounds[i - 1] + std::min(slice_size, end - bounds[i - 1]);
+                const char* eol = pos < end ? static_cast<const char*>(std::memchr(pos, '\n', std::size_t(end - pos))) : nullptr;
+                bounds[i] = eol == nullptr ? end : eol + 1;
+            }
+
+            if(nb_threads <= 1) {
+                lines += parse_block<Format>(bounds[0], bounds[1], builder, filter, counts[0]);
+            } else {
+                yacrd::utils::run_threads(nb_threads, [&](unsigned i) {
+                    shard_lines[i] = parse_block<Format>(bounds[i], bounds[i + 1], shards[i], filter, counts[i]);
+                });
 
-            (*parse_line)(line_stream, alignment, false);
+                for(auto n : shard_lines) {
+                    lines += n;
+                }
 
-            insert(alignment, read2mapping);
+                // Local ids follow the order in which reads were first seen, so global ids do too
+                for(auto& s : shards) {
+                    builder.append(s);
+                }
+            }
+
+            done += std::uint64_t(bounds.back() - begin);
+            begin = bounds.back();
+            if(stats != nullptr) {
+                stats->progress("parser::file", done, total);
+            }
         }
     }
 
+    phase.count(done, lines);
+    if(filter.drop_mirrors) {
+        counts[0].mirrors += drop_mirrors(builder);
+    }
+    read2mapping = builder.build();
+
+    for(std::size_t i = 1 ; i < counts.size() ; i++) {
+        counts[0] += counts[i];
+    }
+    if(filter.drop_duplicates) {
+        counts[0].duplicates += yacrd::utils::collapse_duplicates(read2mapping, nb_threads);
+    }
+    dropped = counts[0];
+    return !reader.failed();
 }
 
+} // namespace
 
-inline void skip(std::istringstream& strm, char sep) {
-    // consuming (>>) leave next sep while ignore consume it
-    strm.get(); // so we have to first consume one char in case a sep was left by >>
-    strm.ignore(std::numeric_limits<std::streamsize>::max(), sep);
+std::uint64_t yacrd::parser::checksum(const prefilter& filter)
+{
+    std::vector<char> values;
+    auto add = [&values](const void* data, std::size_t size) {
+        values.insert(values.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+    };
+    add(&filter.min_block_length, sizeof(filter.min_block_length));
+    add(&filter.min_identity, sizeof(filter.min_identity));
+    add(&filter.min_mapq, sizeof(filter.min_mapq));
+    const char flags[] = {filter.drop_self, filter.drop_duplicates, filter.drop_mirrors};
+    add(flags, sizeof(flags));
+    return yacrd::utils::hash_name(yacrd::utils::string_ref(values.data(), values.size()));
 }
 
-void yacrd::parser::paf_line(std::istringstream& line, yacrd::parser::alignment& out, bool only_names)
+yacrd::parser::mirror_set::line yacrd::parser::mirror_set::make(yacrd::utils::read_id first, yacrd::utils::read_id second, const alignment& align)
 {
-    line >> out.first.name; // Token 0
+    return line{first, second, span_interval(align.first), span_interval(align.second)};
+}
 
-    if(!only_names) {
-        line >> out.first.len >> out.first.beg >> out.first.end;
+std::uint64_t yacrd::parser::mirror_set::hash(const line& l)
+{
+    const std::uint64_t m = 0x9E3779B97F4A7C15ULL;
+    auto side = [m](yacrd::utils::read_id id, yacrd::utils::interval iv) {
+        std::uint64_t h = (std::uint64_t(id) * m) ^ ((std::uint64_t(iv.first) << 32) | iv.second);
+        h *= m;
+        return h ^ (h >> 29);
+    };
 
-        skip(line, '\t'); // Token 4: skip
-    } else {
-        for(unsigned i=0 ; i < 4 ; i++) {
-            skip(line, '\t');
+    // Same hash for the line and its mirror
+    std::uint64_t first = side(l.first, l.first_interval);
+    std::uint64_t second = side(l.second, l.second_interval);
+    std::uint64_t h = (std::min(first, second) ^ (std::max(first, second) >> 29)) * m + std::max(first, second);
+    return h ^ (h >> 32);
+}
+
+bool yacrd::parser::mirror_set::match(const line& l)
+{
+    // A line on the same interval of a read is its own mirror, never stored
+    if(l.first == l.second && l.first_interval == l.second_interval) {
+        return false;
+    }
+
+    std::size_t mask = table.size() - 1;
+    std::size_t pos = hash(l) & mask;
+    for(; !empty(table[pos]) ; pos = (pos + 1) & mask) {
+        const line& t = table[pos];
+        if(t.first == l.second && t.second == l.first && t.first_interval == l.second_interval && t.second_interval == l.first_interval) {
+            erase(pos);
+            return true;
+        }
+        if(t.first == l.first && t.second == l.second && t.first_interval == l.first_interval && t.second_interval == l.second_interval) {
+            return false; // same direction, already waiting
         }
     }
+    table[pos] = l;
 
-    line >> out.second.name; // Token 5
+    // Keep load factor under 1/2
+    if(++count * 2 > table.size()) {
+        grow();
+    }
+    return false;
+}
 
-    if(!only_names) {
-        line >> out.second.len >> out.second.beg >> out.second.end;
+void yacrd::parser::mirror_set::erase(std::size_t pos)
+{
+    // Move back the next lines of the cluster that can't be reached anymore from their slot
+    std::size_t mask = table.size() - 1;
+    for(std::size_t next = (pos + 1) & mask ; !empty(table[next]) ; next = (next + 1) & mask) {
+        std::size_t slot = hash(table[next]) & mask;
+        if(((next - slot) & mask) >= ((next - pos) & mask)) {
+            table[pos] = table[next];
+            pos = next;
+        }
     }
+    table[pos].first = yacrd::utils::name_index::none;
+    count--;
 }
 
-void yacrd::parser::mhap_line(std::istringstream& line, yacrd::parser::alignment& out, bool only_names)
+void yacrd::parser::mirror_set::grow()
 {
-    line >> out.first.name; // Token 0
-    line >> out.second.name;
+    std::vector<line> old(table.size() * 2, line{yacrd::utils::name_index::none, 0, {0, 0}, {0, 0}});
+    old.swap(table);
+    std::size_t mask = table.size() - 1;
+    for(auto& l : old) {
+        if(!empty(l)) {
+            std::size_t pos = hash(l) & mask;
+            while(!empty(table[pos])) {
+                pos = (pos + 1) & mask;
+            }
+            table[pos] = l;
+        }
+    }
+}
 
-    if(!only_names) {
-        for(unsigned i=0 ; i < 3 ; i++) { skip(line, ' '); }
-        line >> out.first.beg >> out.first.end >> out.first.len;
+yacrd::parser::format yacrd::parser::file_format(const std::string& filename)
+{
+    const std::string name = yacrd::compression::strip_extension(filename);
+    if(name.substr(name.find_last_of('.') + 1) == "mhap")
+    {
+        return yacrd::parser::format::mhap;
+    }
+    return yacrd::parser::format::paf;
+}
 
-        skip(line, ' ');
+yacrd::parser::parser_t yacrd::parser::line_parser(const std::string& filename)
+{
+    if(yacrd::parser::file_format(filename) == yacrd::parser::format::mhap)
+    {
+        return yacrd::parser::mhap_line;
+    }
+    return yacrd::parser::paf_line;
+}
 
-        line >> out.second.beg >> out.second.end >> out.second.len;
+std::pair<yacrd::utils::read_id, bool> yacrd::parser::insert(yacrd::parser::alignment_span& span, yacrd::utils::read2mapping_type& read2mapping)
+{
+    // Inserts a new read in the index, if the read wasn't already indexed
+    auto res = read2mapping.insert(span.name, span.len);
+    read2mapping.intervals[res.first].push_back(span_interval(span));
+
+    return res;
+}
+
+bool yacrd::parser::file(const std::string& filename, yacrd::utils::read2mapping_csr& read2mapping, prefilter_counts& dropped, unsigned nb_threads, yacrd::stats::recorder* stats, const prefilter& filter, bool merge_intervals)
+{
+    const bool mhap = yacrd::parser::file_format(filename) == yacrd::parser::format::mhap;
+    if(merge_intervals && !filter.drop_mirrors) {
+        if(mhap) {
+            return parse_file<yacrd::parser::format::mhap, yacrd::utils::union_builder>(filename, read2mapping, dropped, nb_threads, stats, filter);
+        }
+        return parse_file<yacrd::parser::format::paf, yacrd::utils::union_builder>(filename, read2mapping, dropped, nb_threads, stats, filter);
+    }
 
+    if(mhap) {
+        return parse_file<yacrd::parser::format::mhap, yacrd::utils::csr_builder>(filename, read2mapping, dropped, nb_threads, stats, filter);
     }
+    return parse_file<yacrd::parser::format::paf, yacrd::utils::csr_builder>(filename, read2mapping, dropped, nb_threads, stats, filter);
+}
+
+void yacrd::parser::report_dropped(const prefilter_counts& counts, yacrd::stats::recorder* stats)
+{
+    const std::pair<const char*, std::uint64_t> reasons[] = {
+        {"short_block", counts.short_block},
+        {"low_identity", counts.low_identity},
+        {"low_mapq", counts.low_mapq},
+        {"self", counts.self},
+        {"duplicate_intervals", counts.duplicates},
+        {"mirrors", counts.mirrors},
+        {"missing_quality", counts.missing_quality},
+    };
+
+    bool any = false;
+    for(auto& reason : reasons) {
+        if(reason.second != 0) {
+            std::cerr << (any ? ", " : "Pre-filters dropped ") << reason.second << " " << reason.first;
+            any = true;
+        }
+        if(stats != nullptr) {
+            stats->dropped(reason.first, reason.second);
+        }
+    }
+    if(any) {
+        std::cerr << std::endl;
+    }
+
+    if(counts.large_coordinates != 0) {
+        std::cerr << "Warning: " << counts.large_coordinates << " alignments ignored, their lengths or positions are larger than "
+                  << std::numeric_limits<yacrd::utils::coordinate>::max() << std::endl;
+    }
+    if(stats != nullptr) {
+        stats->dropped("large_coordinates", counts.large_coordinates);
+    }
+}
+
+bool yacrd::parser::paf_line(const char* begin, const char* end, yacrd::parser::alignment& out, bool only_names)
+{
+    return yacrd::parser::parse_line<yacrd::parser::format::paf>(begin, end, out, only_names);
+}
+
+bool yacrd::parser::mhap_line(const char* begin, const char* end, yacrd::parser::alignment& out, bool only_names)
+{
+    return yacrd::parser::parse_line<yacrd::parser::format::mhap>(begin, end, out, only_names);
 }
@@ -0,0 +1,457 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <queue>
+#include <memory>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+/* system include */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* project include */
+#include "io.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+#include "partition.hpp"
+
+namespace { // Local definitions
+
+constexpr std::uint64_t compression_ratio = 4;
+constexpr std::size_t sample_size = std::size_t(1) << 20;
+constexpr unsigned max_partitions = 512; // each one keep a file open during the spill
+constexpr std::size_t spill_buffer_size = std::size_t(1) << 18;
+constexpr std::size_t min_spill_buffer_size = std::size_t(1) << 14;
+
+// Buffer size of each of nb_files spill files open together, all of them take at most half of
+// max_memory above the floor
+inline std::size_t spill_buffer(std::uint64_t max_memory, unsigned nb_files)
+{
+    std::uint64_t size = max_memory / (2 * std::uint64_t(std::max(1u, nb_files)));
+    return std::size_t(std::max<std::uint64_t>(min_spill_buffer_size, std::min<std::uint64_t>(spill_buffer_size, size)));
+}
+
+// Unique file created in $TMPDIR or /tmp, removed at destruction
+class temporary_file
+{
+public:
+    temporary_file() {
+        const char* dir = std::getenv("TMPDIR");
+        std::string pattern = std::string(dir != nullptr && dir[0] != '\0' ? dir : "/tmp") + "/yacrd.XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        int fd = ::mkstemp(name.data());
+        if(fd >= 0) {
+            ::close(fd);
+            filename = name.data();
+        }
+    }
+    ~temporary_file() { remove(); }
+
+    temporary_file(const temporary_file&) = delete;
+    temporary_file& operator=(const temporary_file&) = delete;
+
+    bool good() const { return !filename.empty(); }
+    const std::string& path() const { return filename; }
+
+    void remove() {
+        if(!filename.empty()) {
+            ::unlink(filename.c_str());
+            filename.clear();
+        }
+    }
+
+private:
+    std::string filename;
+};
+
+// Sequential reads of fixed size pieces of a spill file
+class spill_reader
+{
+public:
+    explicit spill_reader(const std::string& filename, std::size_t buffer_size = std::size_t(1) << 20) : fd(::open(filename.c_str(), O_RDONLY)), buffer(buffer_size) {
+        if(fd < 0) {
+            std::cerr << "Can't open temporary file " << filename << ": " << std::strerror(errno) << std::endl;
+            error = true;
+        }
+    }
+    ~spill_reader() {
+        if(fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    spill_reader(const spill_reader&) = delete;
+    spill_reader& operator=(const spill_reader&) = delete;
+
+    // Return the next n bytes, valid until the next call. nullptr on error, the end of the file
+    // is an error too: the bytes follow a record read by read().
+    const char* take(std::size_t n) {
+        if(!fill(n)) {
+            truncated();
+            return nullptr;
+        }
+        const char* pos = buffer.data() + begin;
+        begin += n;
+        return pos;
+    }
+
+    // Copy the next sizeof(T) bytes in value, return false at the end of the file or on error
+    template<typename T>
+    bool read(T& value) {
+        if(!fill(sizeof(T))) {
+            if(end != begin) {
+                truncated();
+            }
+            return false;
+        }
+        std::memcpy(&value, buffer.data() + begin, sizeof(T));
+        begin += sizeof(T);
+        return true;
+    }
+
+    // True if the file couldn't be read completely
+    bool failed() const { return error; }
+
+private:
+    // Read until n bytes are buffered, return false if the file ends before or on error
+    bool fill(std::size_t n) {
+        if(end - begin >= n) {
+            return true;
+        }
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+        if(n > buffer.size()) {
+            buffer.resize(n);
+        }
+        while(end < n && !error) {
+            ssize_t got = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if(got < 0 && errno == EINTR) {
+                continue;
+            }
+            if(got < 0) {
+                std::cerr << "Can't read temporary file: " << std::strerror(errno) << std::endl;
+                error = true;
+            }
+            if(got <= 0) {
+                break;
+            }
+            end += std::size_t(got);
+        }
+        return end >= n;
+    }
+
+    void truncated() {
+        if(!error) {
+            std::cerr << "Temporary file ends with an incomplete record" << std::endl;
+            error = true;
+        }
+    }
+
+    int fd;
+    bool error = false;
+    std::vector<char> buffer;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+};
+
+// A span of an alignment in a spill file, followed by its name. key is the rank of the span
+// in the mapping, the key of a read is the one of its first span.
+struct span_record {
+    std::uint64_t key;
+    std::uint64_t len;
+    yacrd::utils::coordinate beg;
+    yacrd::utils::coordinate end;
+    std::uint32_t name_size;
+};
+
+// Report lines of a read in a report spill file, followed by the lines
+struct report_record {
+    std::uint64_t key;
+    std::uint64_t size;
+};
+
+inline unsigned partition_of(yacrd::utils::string_ref name, unsigned nb_partitions)
+{
+    // High bits, low ones place names in the tables of name_index
+    return unsigned((yacrd::utils::hash_name(name) >> 32) % nb_partitions);
+}
+
+inline void write_span(const yacrd::parser::alignment_span& span, std::uint64_t key, yacrd::io::writer& out)
+{
+    auto beg = yacrd::utils::coordinate(span.beg);
+    auto end = yacrd::utils::coordinate(span.end);
+    span_record record;
+    std::memset(&record, 0, sizeof(record)); // no uninitialized padding in the file
+    record.key = key;
+    record.len = span.len;
+    record.beg = std::min(beg, end);
+    record.end = std::max(beg, end);
+    record.name_size = std::uint32_t(span.name.size);
+    out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    out.write(span.name.data, span.name.size);
+}
+
+// Intervals of the spans of a spill file, first_key gets the key of each read.
+// Builder is utils::csr_builder or utils::union_builder. Return false if the file can't be read completely.
+template<typename Builder>
+bool load_spans(const std::string& path, yacrd::utils::read2mapping_csr& read2mapping, std::vector<std::uint64_t>& first_key)
+{
+    Builder builder;
+    spill_reader in(path);
+    span_record record;
+    const char* name;
+    while(in.read(record) && (name = in.take(std::size_t(record.name_size))) != nullptr)
+    {
+        if(builder.insert(yacrd::utils::string_ref(name, record.name_size), record.len, std::make_pair(record.beg, record.end)).second)
+        {
+            first_key.push_back(record.key);
+        }
+    }
+    read2mapping = builder.build();
+    return !in.failed();
+}
+
+} // namespace
+
+unsigned yacrd::partition::count(const std::string& filename, std::uint64_t max_memory)
+{
+    struct stat st;
+    if(max_memory == 0 || ::stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return 1;
+    }
+
+    std::uint64_t size = std::uint64_t(st.st_size);
+    if(yacrd::compression::from_filename(filename) != yacrd::compression::codec::none)
+    {
+        size *= compression_ratio;
+    }
+
+    // Average line length on the start of the file
+    yacrd::io::line_reader reader(filename);
+    const char* begin;
+    const char* end;
+    if(!reader.next(begin, end) || begin == end)
+    {
+        return 1;
+    }
+    std::size_t sample = std::min(sample_size, std::size_t(end - begin));
+    std::size_t lines = std::max<std::size_t>(1, std::count(begin, begin + sample, '\n'));
+
+    std::uint64_t estimate = size / std::max<std::uint64_t>(1, sample / lines) * bytes_per_alignment;
+    std::uint64_t nb_partitions = (estimate + max_memory - 1) / max_memory;
+    return unsigned(std::max<std::uint64_t>(1, std::min<std::uint64_t>(nb_partitions, max_partitions)));
+}
+
+bool yacrd::partition::find_chimera(const std::string& paf_filename, const yacrd::analysis::config& cfg, unsigned nb_partitions, yacrd::utils::read_set& remove_reads)
+{
+    std::vector<std::unique_ptr<temporary_file>> spans, reports;
+    for(unsigned p = 0 ; p < nb_partitions ; p++)
+    {
+        spans.emplace_back(new temporary_file());
+        reports.emplace_back(new temporary_file());
+        if(!spans.back()->good() || !reports.back()->good())
+        {
+            std::cerr << "Can't create temporary files, analyse " << paf_filename << " in memory" << std::endl;
+            yacrd::analysis::config in_memory = cfg;
+            in_memory.max_memory = 0;
+            return yacrd::analysis::find_chimera(paf_filename, in_memory, remove_reads);
+        }
+    }
+
+    // Spill each span in the partition of its read
+    yacrd::parser::prefilter_counts dropped;
+    {
+        yacrd::stats::recorder::phase phase(cfg.stats, "partition::spill");
+        std::vector<std::unique_ptr<yacrd::io::writer>> writers;
+        const std::size_t buffer_size = spill_buffer(cfg.max_memory, nb_partitions);
+        for(unsigned p = 0 ; p < nb_partitions ; p++)
+        {
+            writers.emplace_back(new yacrd::io::writer(spans[p]->path(), 1, buffer_size));
+        }
+
+        yacrd::io::line_reader reader(paf_filename, std::size_t(1) << 24, false);
+        std::uint64_t key = 0;
+        yacrd::parser::for_each_alignment(reader, yacrd::parser::file_format(paf_filename), cfg.prefilter, dropped, [&](yacrd::parser::alignment& alignment) {
+            write_span(alignment.first, key, *writers[partition_of(alignment.first.name, nb_partitions)]);
+            write_span(alignment.second, key + 1, *writers[partition_of(alignment.second.name, nb_partitions)]);
+            key += 2;
+        });
+        phase.count(reader.consumed(), key / 2);
+        if(reader.failed())
+        {
+            return false;
+        }
+        for(auto& writer : writers)
+        {
+            if(!writer->close())
+            {
+                return false;
+            }
+        }
+    }
+
+    // Analyse partitions one by one, spill their reports with the key of each read
+    yacrd::utils::name_index removed;
+    std::vector<yacrd::utils::interval_vector> removed_segments; // of each removed read with cfg.split
+    std::uint64_t nb_reads = 0, nb_intervals = 0, max_intervals = 0;
+    for(unsigned p = 0 ; p < nb_partitions ; p++)
+    {
+        yacrd::utils::read2mapping_csr read2mapping;
+        std::vector<std::uint64_t> first_key;
+        {
+            yacrd::stats::recorder::phase phase(cfg.stats, "partition::load");
+            const bool loaded = yacrd::sweep::union_only(cfg.engine, cfg.coverage_mins) && !cfg.prefilter.drop_duplicates
+                ? load_spans<yacrd::utils::union_builder>(spans[p]->path(), read2mapping, first_key)
+                : load_spans<yacrd::utils::csr_builder>(spans[p]->path(), read2mapping, first_key);
+            spans[p]->remove();
+            if(!loaded)
+            {
+                return false;
+            }
+            if(cfg.prefilter.drop_duplicates)
+            {
+                dropped.duplicates += yacrd::utils::collapse_duplicates(read2mapping, cfg.nb_threads);
+            }
+        }
+
+        nb_reads += read2mapping.size();
+        nb_intervals += read2mapping.offsets.back();
+        if(cfg.stats != nullptr)
+        {
+            for(yacrd::utils::read_id id = 0 ; id < read2mapping.size() ; id++)
+            {
+                max_intervals = std::max<std::uint64_t>(max_intervals, read2mapping.offsets[id + 1] - read2mapping.offsets[id]);
+            }
+        }
+
+        auto results = yacrd::analysis::analyse_blocks(read2mapping, cfg);
+        read2mapping.intervals.reset();
+
+        yacrd::io::writer out(reports[p]->path(), 1, spill_buffer_size);
+        for(auto& result : results)
+        {
+            std::size_t begin = 0;
+            for(std::size_t i = 0 ; i < result.flagged.size() ; i++)
+            {
+                report_record record{first_key[result.flagged[i]], result.report_ends[i] - begin};
+                out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+                out.write(result.report.data() + begin, record.size);
+                begin = result.report_ends[i];
+            }
+            for(std::size_t i = 0 ; i < result.remove_reads.size() ; i++)
+            {
+                removed.insert(read2mapping.names.name(result.remove_reads[i]));
+                if(cfg.split)
+                {
+                    removed_segments.push_back(std::move(result.remove_segments[i]));
+                }
+            }
+            result = yacrd::analysis::block_result();
+        }
+        if(!out.close())
+        {
+            return false;
+        }
+    }
+
+    yacrd::parser::report_dropped(dropped, cfg.stats);
+    if(cfg.stats != nullptr)
+    {
+        cfg.stats->mapping(nb_reads, nb_intervals, max_intervals);
+    }
+
+    // Merge reports of partitions by key, the order of find_chimera
+    yacrd::stats::recorder::phase phase(cfg.stats, "partition::merge");
+    yacrd::io::writer out(cfg.report.empty() ? "-" : cfg.report, cfg.nb_threads);
+    if(!out.good())
+    {
+        return false;
+    }
+    yacrd::report::write_header(cfg.report_format, out);
+
+    std::vector<std::unique_ptr<spill_reader>> readers;
+    std::vector<report_record> heads(nb_partitions);
+    using head = std::pair<std::uint64_t, unsigned>;
+    std::priority_queue<head, std::vector<head>, std::greater<head>> queue;
+    const std::size_t buffer_size = spill_buffer(cfg.max_memory, nb_partitions);
+    for(unsigned p = 0 ; p < nb_partitions ; p++)
+    {
+        readers.emplace_back(new spill_reader(reports[p]->path(), buffer_size));
+        if(readers[p]->read(heads[p]))
+        {
+            queue.emplace(heads[p].key, p);
+        }
+        else if(readers[p]->failed())
+        {
+            return false;
+        }
+    }
+    while(!queue.empty())
+    {
+        unsigned p = queue.top().second;
+        queue.pop();
+        const char* lines = readers[p]->take(heads[p].size);
+        if(lines == nullptr)
+        {
+            return false;
+        }
+        out.write(lines, heads[p].size);
+        if(readers[p]->read(heads[p]))
+        {
+            queue.emplace(heads[p].key, p);
+        }
+        else if(readers[p]->failed())
+        {
+            return false;
+        }
+    }
+    if(!out.close())
+    {
+        return false;
+    }
+
+    remove_reads = yacrd::utils::read_set(std::move(removed));
+    for(yacrd::utils::read_id id = 0 ; id < remove_reads.index().size() ; id++)
+    {
+        if(cfg.split)
+        {
+            remove_reads.insert(id, std::move(removed_segments[id]));
+        }
+        else
+        {
+            remove_reads.insert(id);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,197 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <cstring>
+
+/* project include */
+#include "report.hpp"
+
+namespace { // Local definitions
+
+// "00" to "99", two digits are written per division
+const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// Little endian bytes of value, whatever the host
+template<typename T>
+inline void append_raw(std::string& out, T value)
+{
+    char bytes[sizeof(T)];
+    for(std::size_t i = 0 ; i < sizeof(T) ; i++) {
+        bytes[i] = char(std::uint64_t(value) >> (8 * i) & 0xff);
+    }
+    out.append(bytes, sizeof(T));
+}
+
+// Call f(begin, end) on the leading gap, middle gaps and trailing gap in read order
+template<typename F>
+inline void for_each_gap(const yacrd::report::record& r, F f)
+{
+    if(r.gaps->first_covered != 0) {
+        f(std::uint64_t(0), std::uint64_t(r.gaps->first_covered));
+    }
+    for(auto gap : r.gaps->middle_gaps) {
+        f(std::uint64_t(gap.first), std::uint64_t(gap.second));
+    }
+    if(r.gaps->last_covered != r.length) {
+        f(std::uint64_t(r.gaps->last_covered), r.length);
+    }
+}
+
+inline std::uint32_t nb_gaps(const yacrd::report::record& r)
+{
+    return std::uint32_t(r.gaps->first_covered != 0) + std::uint32_t(r.gaps->last_covered != r.length) + std::uint32_t(r.gaps->middle_gaps.size());
+}
+
+inline const char* label_name(yacrd::report::label type)
+{
+    return type == yacrd::report::label::chimeric ? "Chimeric\t" : "Not_covered\t";
+}
+
+void append_text(const yacrd::report::record& r, std::string& out)
+{
+    if(r.show_coverage) {
+        yacrd::report::append_uint(out, r.coverage_min);
+        out += '\t';
+    }
+    out += label_name(r.type);
+    out.append(r.name.data, r.name.size);
+    out += '\t';
+    yacrd::report::append_uint(out, r.length);
+    out += '\t';
+
+    char separator = '\0';
+    for_each_gap(r, [&](std::uint64_t begin, std::uint64_t end) {
+        if(separator != '\0') {
+            out += separator;
+        }
+        yacrd::report::append_uint(out, end - begin);
+        out += ',';
+        yacrd::report::append_uint(out, begin);
+        out += ',';
+        yacrd::report::append_uint(out, end);
+        separator = ';';
+    });
+    out += '\n';
+}
+
+void append_tsv(const yacrd::report::record& r, std::string& out)
+{
+    for_each_gap(r, [&](std::uint64_t begin, std::uint64_t end) {
+        yacrd::report::append_uint(out, r.coverage_min);
+        out += '\t';
+        out += label_name(r.type);
+        out.append(r.name.data, r.name.size);
+        out += '\t';
+        yacrd::report::append_uint(out, r.length);
+        out += '\t';
+        yacrd::report::append_uint(out, end - begin);
+        out += '\t';
+        yacrd::report::append_uint(out, begin);
+        out += '\t';
+        yacrd::report::append_uint(out, end);
+        out += '\n';
+    });
+}
+
+void append_binary(const yacrd::report::record& r, std::string& out)
+{
+    append_raw<std::uint64_t>(out, r.coverage_min);
+    append_raw<std::uint64_t>(out, r.length);
+    append_raw<std::uint32_t>(out, std::uint32_t(r.name.size));
+    append_raw<std::uint32_t>(out, nb_gaps(r));
+    append_raw<std::uint8_t>(out, static_cast<std::uint8_t>(r.type));
+    out.append(r.name.data, r.name.size);
+    for_each_gap(r, [&](std::uint64_t begin, std::uint64_t end) {
+        append_raw<std::uint64_t>(out, begin);
+        append_raw<std::uint64_t>(out, end);
+    });
+}
+
+} // namespace
+
+bool yacrd::report::format_from_name(const std::string& name, format& value)
+{
+    if(name == "text") {
+        value = format::text;
+    } else if(name == "tsv") {
+        value = format::tsv;
+    } else if(name == "binary") {
+        value = format::binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void yacrd::report::append_uint(std::string& out, std::uint64_t value)
+{
+    char buffer[20];
+    char* pos = buffer + sizeof(buffer);
+    while(value >= 100) {
+        const std::size_t pair = std::size_t(value % 100) * 2;
+        value /= 100;
+        *--pos = digit_pairs[pair + 1];
+        *--pos = digit_pairs[pair];
+    }
+    if(value >= 10) {
+        const std::size_t pair = std::size_t(value) * 2;
+        *--pos = digit_pairs[pair + 1];
+        *--pos = digit_pairs[pair];
+    } else {
+        *--pos = char('0' + value);
+    }
+    out.append(pos, std::size_t(buffer + sizeof(buffer) - pos));
+}
+
+void yacrd::report::write_header(format fmt, yacrd::io::writer& out)
+{
+    if(fmt == format::tsv) {
+        const char header[] = "coverage_min\ttype\tread\tlength\tgap_length\tgap_begin\tgap_end\n";
+        out.write(header, sizeof(header) - 1);
+    } else if(fmt == format::binary) {
+        std::string header(binary_magic, sizeof(binary_magic));
+        append_raw<std::uint32_t>(header, binary_version);
+        out.write(header.data(), header.size());
+    }
+}
+
+void yacrd::report::append(format fmt, const record& r, std::string& out)
+{
+    if(fmt == format::tsv) {
+        append_tsv(r, out);
+    } else if(fmt == format::binary) {
+        append_binary(r, out);
+    } else {
+        append_text(r, out);
+    }
+}
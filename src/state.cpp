@@ -0,0 +1,587 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <vector>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+/* system include */
+#include <unistd.h>
+#include <sys/types.h>
+
+/* project include */
+#include "io.hpp"
+#include "state.hpp"
+#include "parser.hpp"
+#include "report.hpp"
+
+namespace { // Local definitions
+
+const char magic[8] = {'Y', 'A', 'C', 'R', 'D', 'S', 'T', 'A'};
+
+struct header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t interval_size;
+    std::uint64_t prefilter_checksum;
+};
+
+// Start of the record of a batch, followed by its sections in the order of batch_record
+struct batch_header {
+    std::uint64_t config_checksum;
+    std::uint64_t nb_new_reads;
+    std::uint64_t names_size;
+    std::uint64_t nb_touched;   // reads with intervals in the batch
+    std::uint64_t nb_intervals;
+    std::uint64_t nb_verdicts;  // reads analysed by the run
+    std::uint64_t reports_size;
+    std::uint64_t nb_covered;
+};
+
+// Sections of the record of a batch
+struct batch_record {
+    // New reads
+    std::vector<std::uint64_t> name_sizes;
+    std::vector<std::uint64_t> lengths;
+    std::vector<char> names;
+
+    // Intervals of the batch
+    std::vector<yacrd::utils::read_id> ids;
+    std::vector<std::uint64_t> counts;
+    yacrd::utils::interval_vector intervals;
+
+    // Verdicts of the reads analysed, report lines and covered segments in the order of verdict_ids
+    std::vector<yacrd::utils::read_id> verdict_ids;
+    std::vector<std::uint8_t> removed;
+    std::vector<std::uint64_t> report_sizes;
+    std::vector<std::uint64_t> covered_sizes;
+    std::vector<char> reports;
+    yacrd::utils::interval_vector covered;
+};
+
+template<typename T>
+inline void write_section(std::ofstream& out, const std::vector<T>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), std::streamsize(values.size() * sizeof(T)));
+}
+
+template<typename T>
+inline bool read_section(std::ifstream& in, T* data, std::size_t n) {
+    return bool(in.read(reinterpret_cast<char*>(data), std::streamsize(n * sizeof(T))));
+}
+
+template<typename T>
+inline bool read_section(std::ifstream& in, std::vector<T>& values, std::size_t n) {
+    values.resize(n);
+    return read_section(in, values.data(), n);
+}
+
+inline bool file_exists(const std::string& path) {
+    return ::access(path.c_str(), F_OK) == 0;
+}
+
+inline std::uint64_t sum(const std::vector<std::uint64_t>& values) {
+    std::uint64_t total = 0;
+    for(auto v : values) {
+        total += v;
+    }
+    return total;
+}
+
+batch_header header_of(const batch_record& record, std::uint64_t config_checksum)
+{
+    return batch_header{config_checksum, record.name_sizes.size(), record.names.size(), record.ids.size(), record.intervals.size(),
+                        record.verdict_ids.size(), record.reports.size(), record.covered.size()};
+}
+
+// Bytes of the record of b, 0 if one of its sizes is above max
+std::uint64_t record_size(const batch_header& b, std::uint64_t max)
+{
+    for(auto count : {b.nb_new_reads, b.names_size, b.nb_touched, b.nb_intervals, b.nb_verdicts, b.reports_size, b.nb_covered})
+    {
+        if(count > max)
+        {
+            return 0;
+        }
+    }
+    return sizeof(b) + b.nb_new_reads * 2 * sizeof(std::uint64_t) + b.names_size
+        + b.nb_touched * (sizeof(yacrd::utils::read_id) + sizeof(std::uint64_t)) + b.nb_intervals * sizeof(yacrd::utils::interval)
+        + b.nb_verdicts * (sizeof(yacrd::utils::read_id) + sizeof(std::uint8_t) + 2 * sizeof(std::uint64_t))
+        + b.reports_size + b.nb_covered * sizeof(yacrd::utils::interval);
+}
+
+// Add a read without intervals nor verdict, return false if its name is already in the state
+bool add_read(yacrd::state::mapping_state& state, yacrd::utils::string_ref name, std::uint64_t len)
+{
+    if(!state.names.insert(name).second)
+    {
+        return false;
+    }
+    state.lengths.push_back(len);
+    state.nb_intervals.push_back(0);
+    state.removed.push_back(0);
+    state.report_begin.push_back(0);
+    state.report_end.push_back(0);
+    state.covered_begin.push_back(0);
+    state.covered_end.push_back(0);
+    return true;
+}
+
+// Count the intervals of the batch and replace the verdicts of its reads, new reads are already in state
+void apply(yacrd::state::mapping_state& state, const batch_record& record)
+{
+    for(std::size_t i = 0 ; i < record.ids.size() ; i++)
+    {
+        state.nb_intervals[record.ids[i]] += record.counts[i];
+    }
+
+    // Replaced lines and segments stay in the arenas, they are as large as in the state file
+    auto report = record.reports.begin();
+    auto covered = record.covered.begin();
+    for(std::size_t i = 0 ; i < record.verdict_ids.size() ; i++)
+    {
+        yacrd::utils::read_id id = record.verdict_ids[i];
+        state.removed[id] = record.removed[i];
+
+        state.report_begin[id] = state.reports.size();
+        state.reports.insert(state.reports.end(), report, report + std::ptrdiff_t(record.report_sizes[i]));
+        state.report_end[id] = state.reports.size();
+        report += std::ptrdiff_t(record.report_sizes[i]);
+
+        state.covered_begin[id] = state.covered.size();
+        state.covered.insert(state.covered.end(), covered, covered + std::ptrdiff_t(record.covered_sizes[i]));
+        state.covered_end[id] = state.covered.size();
+        covered += std::ptrdiff_t(record.covered_sizes[i]);
+    }
+}
+
+// Add the new reads of batch to state and record, return the batch id of each read of the state,
+// name_index::none if the read isn't in the batch
+std::vector<yacrd::utils::read_id> merge(yacrd::state::mapping_state& state, yacrd::utils::read2mapping_csr& batch, batch_record& record)
+{
+    std::vector<yacrd::utils::read_id> batch_of(state.names.size(), yacrd::utils::name_index::none);
+    for(yacrd::utils::read_id id = 0 ; id < batch.size() ; id++)
+    {
+        yacrd::utils::string_ref name = batch.names.name(id);
+        yacrd::utils::read_id state_id = state.names.find(name);
+        if(state_id == yacrd::utils::name_index::none)
+        {
+            state_id = yacrd::utils::read_id(state.names.size());
+            add_read(state, name, batch.lengths[id]);
+            batch_of.push_back(yacrd::utils::name_index::none);
+            record.name_sizes.push_back(name.size);
+            record.lengths.push_back(batch.lengths[id]);
+            record.names.insert(record.names.end(), name.data, name.data + name.size);
+        }
+        batch_of[state_id] = id;
+    }
+    return batch_of;
+}
+
+// Intervals of the reads of ids from the state file then from the batch, read i of out is ids[i]
+bool gather(const std::string& state_path, const yacrd::state::mapping_state& state, const std::vector<yacrd::utils::read_id>& ids,
+            const std::vector<yacrd::utils::read_id>& batch_of, yacrd::utils::read2mapping_csr& batch, yacrd::utils::read2mapping_csr& out)
+{
+    std::vector<yacrd::utils::read_id> position(state.names.size(), yacrd::utils::name_index::none);
+    out.offsets.assign(ids.size() + 1, 0);
+    for(std::size_t i = 0 ; i < ids.size() ; i++)
+    {
+        yacrd::utils::read_id id = ids[i];
+        position[id] = yacrd::utils::read_id(i);
+        out.names.insert(state.names.name(id));
+        out.lengths.push_back(state.lengths[id]);
+        std::uint64_t count = state.nb_intervals[id];
+        if(batch_of[id] != yacrd::utils::name_index::none)
+        {
+            count += batch.offsets[batch_of[id] + 1] - batch.offsets[batch_of[id]];
+        }
+        out.offsets[i + 1] = out.offsets[i] + count;
+    }
+
+    out.intervals = yacrd::utils::huge_array<yacrd::utils::interval>(out.offsets.back());
+    std::vector<std::uint64_t> next(out.offsets.begin(), out.offsets.end() - 1);
+    if(!state.batches.empty())
+    {
+        std::ifstream in(state_path, std::ios::binary);
+        for(auto& b : state.batches)
+        {
+            std::uint64_t offset = b.offset;
+            for(std::size_t i = 0 ; i < b.ids.size() ; i++)
+            {
+                yacrd::utils::read_id pos = position[b.ids[i]];
+                if(pos != yacrd::utils::name_index::none)
+                {
+                    if(!(in.seekg(std::streamoff(offset)) && read_section(in, out.intervals.data() + next[pos], b.counts[i])))
+                    {
+                        return false;
+                    }
+                    next[pos] += b.counts[i];
+                }
+                offset += b.counts[i] * sizeof(yacrd::utils::interval);
+            }
+        }
+    }
+
+    for(std::size_t i = 0 ; i < ids.size() ; i++)
+    {
+        if(batch_of[ids[i]] != yacrd::utils::name_index::none)
+        {
+            std::copy(batch.begin(batch_of[ids[i]]), batch.end(batch_of[ids[i]]), out.intervals.data() + next[i]);
+        }
+    }
+    return true;
+}
+
+// Remove the batch intervals of each read that repeat one of its state intervals, return their number.
+// The state_counts[id] first intervals of read id come from the state, they are unique.
+std::uint64_t drop_repeated(yacrd::utils::read2mapping_csr& read2mapping, const std::vector<std::uint64_t>& state_counts)
+{
+    std::uint64_t dropped = 0;
+    std::uint64_t out = 0;
+    std::vector<std::uint64_t> offsets(1, 0);
+    offsets.reserve(read2mapping.offsets.size());
+    for(yacrd::utils::read_id id = 0 ; id < read2mapping.size() ; id++)
+    {
+        const std::uint64_t begin = read2mapping.offsets[id];
+        const std::uint64_t batch_begin = begin + state_counts[id];
+        std::sort(read2mapping.begin(id), read2mapping.begin(id) + state_counts[id]);
+
+        const std::uint64_t first = out;
+        for(std::uint64_t i = begin ; i < batch_begin ; i++)
+        {
+            read2mapping.intervals[out++] = read2mapping.intervals[i];
+        }
+        for(std::uint64_t i = batch_begin ; i < read2mapping.offsets[id + 1] ; i++)
+        {
+            if(std::binary_search(read2mapping.intervals.data() + first, read2mapping.intervals.data() + first + state_counts[id], read2mapping.intervals[i]))
+            {
+                dropped++;
+            }
+            else
+            {
+                read2mapping.intervals[out++] = read2mapping.intervals[i];
+            }
+        }
+        offsets.push_back(out);
+    }
+    read2mapping.offsets = std::move(offsets);
+    return dropped;
+}
+
+// Append the record at the end of the complete batches of the state file. A new state (size 0)
+// is only given when the file didn't exist, it's then created by this run.
+bool append(const std::string& state_path, const yacrd::state::mapping_state& state, const batch_record& record, const yacrd::analysis::config& cfg)
+{
+    const bool create = state.size == 0;
+    if(!create && ::truncate(state_path.c_str(), off_t(state.size)) != 0) // drop an incomplete batch
+    {
+        std::cerr << "Can't write state " << state_path << std::endl;
+        return false;
+    }
+
+    std::ofstream out(state_path, std::ios::binary | (create ? std::ios::trunc : std::ios::app));
+    if(create)
+    {
+        header h;
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = yacrd::state::version;
+        h.interval_size = sizeof(yacrd::utils::interval);
+        h.prefilter_checksum = yacrd::parser::checksum(cfg.prefilter);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    }
+
+    batch_header b = header_of(record, yacrd::state::config_checksum(cfg));
+    out.write(reinterpret_cast<const char*>(&b), sizeof(b));
+    write_section(out, record.name_sizes);
+    write_section(out, record.lengths);
+    write_section(out, record.names);
+    write_section(out, record.ids);
+    write_section(out, record.counts);
+    write_section(out, record.intervals);
+    write_section(out, record.verdict_ids);
+    write_section(out, record.removed);
+    write_section(out, record.report_sizes);
+    write_section(out, record.covered_sizes);
+    write_section(out, record.reports);
+    write_section(out, record.covered);
+
+    if(!out.flush())
+    {
+        std::cerr << "Can't write state " << state_path << std::endl;
+        out.close();
+        if(::truncate(state_path.c_str(), off_t(state.size)) != 0) // load() ignores an incomplete batch anyway
+        {
+            std::cerr << "State " << state_path << " ends with an incomplete batch" << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+std::uint64_t yacrd::state::config_checksum(const yacrd::analysis::config& cfg)
+{
+    std::vector<char> values;
+    auto add = [&values](const void* data, std::size_t size) {
+        values.insert(values.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+    };
+    for(auto coverage_min : cfg.coverage_mins)
+    {
+        add(&coverage_min, sizeof(coverage_min));
+    }
+    add(&cfg.coverage_ratio_min, sizeof(cfg.coverage_ratio_min));
+    auto format = static_cast<std::uint32_t>(cfg.report_format);
+    add(&format, sizeof(format));
+    std::uint64_t prefilter = yacrd::parser::checksum(cfg.prefilter);
+    add(&prefilter, sizeof(prefilter));
+    return yacrd::utils::hash_name(yacrd::utils::string_ref(values.data(), values.size()));
+}
+
+bool yacrd::state::load(const std::string& state_path, mapping_state& state, const yacrd::analysis::config& cfg)
+{
+    std::ifstream in(state_path, std::ios::binary);
+    if(!in) {
+        std::cerr << "Can't open state " << state_path << std::endl;
+        return false;
+    }
+    in.seekg(0, std::ios::end);
+    const std::uint64_t file_size = std::uint64_t(in.tellg());
+    in.seekg(0);
+
+    header h;
+    if(!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || std::memcmp(h.magic, magic, sizeof(magic)) != 0) {
+        std::cerr << state_path << " isn't a yacrd state" << std::endl;
+        return false;
+    }
+    if(h.version != yacrd::state::version || h.interval_size != sizeof(yacrd::utils::interval)) {
+        std::cerr << "State " << state_path << " was built by another version of yacrd" << std::endl;
+        return false;
+    }
+    if(h.prefilter_checksum != yacrd::parser::checksum(cfg.prefilter)) {
+        std::cerr << "State " << state_path << " was built with other pre-filters" << std::endl;
+        return false;
+    }
+
+    state = mapping_state();
+    state.size = sizeof(h);
+    batch_header b;
+    while(state.size < file_size && in.read(reinterpret_cast<char*>(&b), sizeof(b)))
+    {
+        const std::uint64_t size = record_size(b, file_size);
+        if(size == 0 || size > file_size - state.size) {
+            break;
+        }
+
+        // Intervals are skipped, gather() reads the ones it needs
+        batch_record record;
+        bool valid = read_section(in, record.name_sizes, b.nb_new_reads)
+            && read_section(in, record.lengths, b.nb_new_reads)
+            && read_section(in, record.names, b.names_size)
+            && read_section(in, record.ids, b.nb_touched)
+            && read_section(in, record.counts, b.nb_touched);
+        const std::uint64_t intervals_offset = std::uint64_t(in.tellg());
+        valid = valid && in.seekg(std::streamoff(b.nb_intervals * sizeof(yacrd::utils::interval)), std::ios::cur)
+            && read_section(in, record.verdict_ids, b.nb_verdicts)
+            && read_section(in, record.removed, b.nb_verdicts)
+            && read_section(in, record.report_sizes, b.nb_verdicts)
+            && read_section(in, record.covered_sizes, b.nb_verdicts)
+            && read_section(in, record.reports, b.reports_size)
+            && read_section(in, record.covered, b.nb_covered)
+            && sum(record.name_sizes) == b.names_size && sum(record.counts) == b.nb_intervals
+            && sum(record.report_sizes) == b.reports_size && sum(record.covered_sizes) == b.nb_covered;
+
+        std::size_t name_begin = 0;
+        for(std::size_t i = 0 ; valid && i < record.name_sizes.size() ; i++) {
+            valid = add_read(state, yacrd::utils::string_ref(record.names.data() + name_begin, record.name_sizes[i]), record.lengths[i]);
+            name_begin += record.name_sizes[i];
+        }
+        for(auto id : record.ids) {
+            valid = valid && id < state.names.size();
+        }
+        for(auto id : record.verdict_ids) {
+            valid = valid && id < state.names.size();
+        }
+        if(!valid) {
+            std::cerr << "State " << state_path << " is corrupted" << std::endl;
+            state = mapping_state();
+            return false;
+        }
+
+        apply(state, record);
+        state.batches.push_back(batch_intervals{intervals_offset, std::move(record.ids), std::move(record.counts)});
+        state.checksum = b.config_checksum;
+        state.size += size;
+    }
+
+    if(state.size < file_size) {
+        std::cerr << "State " << state_path << " ends with an incomplete batch, ignored" << std::endl;
+    }
+    return true;
+}
+
+bool yacrd::state::find_chimera(const std::string& batch_filename, const yacrd::analysis::config& cfg, yacrd::utils::read_set& remove_reads)
+{
+    mapping_state state;
+    if(file_exists(cfg.state))
+    {
+        yacrd::stats::recorder::phase phase(cfg.stats, "state::load");
+        if(!load(cfg.state, state, cfg))
+        {
+            std::cerr << "State " << cfg.state << " rejected, its batches are kept: remove it or use another path to start a new one" << std::endl;
+            return false;
+        }
+    }
+
+    const bool same_config = state.lengths.empty() || state.checksum == config_checksum(cfg);
+    if(!same_config)
+    {
+        std::cerr << "State " << cfg.state << " was computed with other parameters, all reads are analysed again" << std::endl;
+    }
+
+    // Reads of the batch, or all reads with other parameters, are analysed with all their intervals
+    batch_record record;
+    std::vector<yacrd::utils::read_id> ids;
+    std::vector<std::uint64_t> state_counts;
+    yacrd::utils::read2mapping_csr read2mapping;
+    {
+        yacrd::utils::read2mapping_csr batch;
+        yacrd::parser::prefilter_counts dropped;
+        if(!yacrd::parser::file(batch_filename, batch, dropped, cfg.nb_threads, cfg.stats, cfg.prefilter))
+        {
+            return false;
+        }
+
+        yacrd::stats::recorder::phase phase(cfg.stats, "state::merge");
+        std::vector<yacrd::utils::read_id> batch_of = merge(state, batch, record);
+        for(yacrd::utils::read_id id = 0 ; id < batch_of.size() ; id++)
+        {
+            if(!same_config || batch_of[id] != yacrd::utils::name_index::none)
+            {
+                ids.push_back(id);
+                state_counts.push_back(state.nb_intervals[id]);
+            }
+        }
+
+        if(!gather(cfg.state, state, ids, batch_of, batch, read2mapping))
+        {
+            std::cerr << "Can't read intervals of state " << cfg.state << std::endl;
+            return false;
+        }
+
+        // Intervals of the batch can repeat ones of the previous batches
+        if(cfg.prefilter.drop_duplicates)
+        {
+            dropped.duplicates += drop_repeated(read2mapping, state_counts);
+        }
+        yacrd::parser::report_dropped(dropped, cfg.stats);
+
+        for(yacrd::utils::read_id i = 0 ; i < ids.size() ; i++)
+        {
+            std::uint64_t count = read2mapping.offsets[i + 1] - read2mapping.offsets[i] - state_counts[i];
+            if(count != 0)
+            {
+                record.ids.push_back(ids[i]);
+                record.counts.push_back(count);
+                record.intervals.insert(record.intervals.end(), read2mapping.end(i) - count, read2mapping.end(i));
+            }
+        }
+    }
+
+    // Covered segments are always kept, a later run with --split needs the ones of reads it doesn't analyse
+    yacrd::analysis::config analysis_cfg = cfg;
+    analysis_cfg.split = true;
+    auto results = yacrd::analysis::analyse_blocks(read2mapping, analysis_cfg);
+    read2mapping.intervals.reset();
+
+    record.verdict_ids = ids;
+    record.removed.assign(ids.size(), 0);
+    record.report_sizes.assign(ids.size(), 0);
+    record.covered_sizes.assign(ids.size(), 0);
+    for(auto& result : results)
+    {
+        // Results are in read order, so are their lines and segments
+        std::size_t begin = 0;
+        for(std::size_t i = 0 ; i < result.flagged.size() ; i++)
+        {
+            record.report_sizes[result.flagged[i]] = result.report_ends[i] - begin;
+            begin = result.report_ends[i];
+        }
+        record.reports.insert(record.reports.end(), result.report.begin(), result.report.end());
+        for(std::size_t i = 0 ; i < result.remove_reads.size() ; i++)
+        {
+            record.removed[result.remove_reads[i]] = 1;
+            record.covered_sizes[result.remove_reads[i]] = result.remove_segments[i].size();
+            record.covered.insert(record.covered.end(), result.remove_segments[i].begin(), result.remove_segments[i].end());
+        }
+        result = yacrd::analysis::block_result();
+    }
+    apply(state, record);
+
+    if(cfg.stats != nullptr)
+    {
+        std::uint64_t nb_intervals = 0, max_intervals = 0;
+        for(auto count : state.nb_intervals)
+        {
+            nb_intervals += count;
+            max_intervals = std::max(max_intervals, count);
+        }
+        cfg.stats->mapping(state.lengths.size(), nb_intervals, max_intervals);
+    }
+
+    {
+        yacrd::io::writer out(cfg.report.empty() ? "-" : cfg.report, cfg.nb_threads);
+        yacrd::report::write_header(cfg.report_format, out);
+        for(yacrd::utils::read_id id = 0 ; id < state.lengths.size() ; id++)
+        {
+            out.write(state.reports.data() + state.report_begin[id], state.report_end[id] - state.report_begin[id]);
+        }
+        if(!out.close())
+        {
+            return false;
+        }
+    }
+
+    {
+        yacrd::stats::recorder::phase phase(cfg.stats, "state::save");
+        if(!append(cfg.state, state, record, cfg))
+        {
+            return false;
+        }
+    }
+
+    remove_reads = yacrd::utils::read_set(std::move(state.names));
+    for(yacrd::utils::read_id id = 0 ; id < state.removed.size() ; id++)
+    {
+        if(state.removed[id] && cfg.split)
+        {
+            remove_reads.insert(id, yacrd::utils::interval_vector(state.covered.begin() + std::ptrdiff_t(state.covered_begin[id]), state.covered.begin() + std::ptrdiff_t(state.covered_end[id])));
+        }
+        else if(state.removed[id])
+        {
+            remove_reads.insert(id);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,176 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+/* system include */
+#include <sys/resource.h>
+
+/* project include */
+#include "stats.hpp"
+
+namespace { // Local definitions
+
+inline double seconds(const struct timeval& tv) {
+    return double(tv.tv_sec) + double(tv.tv_usec) / 1e6;
+}
+
+inline double per_second(std::uint64_t count, double seconds) {
+    return seconds > 0 ? double(count) / seconds : 0;
+}
+
+} // namespace
+
+double yacrd::stats::cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+}
+
+long yacrd::stats::peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+yacrd::stats::recorder::phase::phase(recorder* owner, std::string name)
+    : owner(owner), record{std::move(name), 0, 0, 0, 0}
+{
+    if(owner != nullptr) {
+        wall_start = std::chrono::steady_clock::now();
+        cpu_start = cpu_seconds();
+    }
+}
+
+yacrd::stats::recorder::phase::~phase()
+{
+    if(owner == nullptr) {
+        return;
+    }
+    record.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    record.cpu_seconds = cpu_seconds() - cpu_start;
+
+    std::lock_guard<std::mutex> lock(owner->progress_mutex);
+    if(owner->progress_shown) { // end the progress line
+        std::cerr << std::endl;
+        owner->progress_shown = false;
+    }
+    owner->phases.push_back(std::move(record));
+}
+
+void yacrd::stats::recorder::progress(const char* name, std::uint64_t done, std::uint64_t total)
+{
+    if(!show_progress) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(progress_mutex);
+    auto now = std::chrono::steady_clock::now();
+    if(progress_shown && now - last_progress < std::chrono::seconds(1)) {
+        return;
+    }
+    last_progress = now;
+    progress_shown = true;
+
+    char line[128];
+    if(total != 0) {
+        std::snprintf(line, sizeof(line), "\r%s: %.1f%% (%llu / %llu)", name, 100.0 * double(done) / double(total),
+                      static_cast<unsigned long long>(done), static_cast<unsigned long long>(total));
+    } else {
+        std::snprintf(line, sizeof(line), "\r%s: %llu", name, static_cast<unsigned long long>(done));
+    }
+    std::cerr << line << std::flush;
+}
+
+void yacrd::stats::recorder::mapping(std::uint64_t reads, std::uint64_t intervals, std::uint64_t max_intervals)
+{
+    this->reads = reads;
+    this->intervals = intervals;
+    this->max_intervals = max_intervals;
+}
+
+void yacrd::stats::recorder::dropped(const std::string& reason, std::uint64_t count)
+{
+    for(auto& d : drops) {
+        if(d.first == reason) {
+            d.second += count;
+            return;
+        }
+    }
+    drops.emplace_back(reason, count);
+}
+
+void yacrd::stats::recorder::print(std::ostream& out) const
+{
+    char line[256];
+    out << "phase\twall_s\tcpu_s\tbytes\tMB/s\tlines\tlines/s\n";
+    for(auto& p : phases) {
+        std::snprintf(line, sizeof(line), "%s\t%.3f\t%.3f\t%llu\t%.1f\t%llu\t%.0f\n", p.name.c_str(), p.wall_seconds, p.cpu_seconds,
+                      static_cast<unsigned long long>(p.bytes), per_second(p.bytes, p.wall_seconds) / 1e6,
+                      static_cast<unsigned long long>(p.lines), per_second(p.lines, p.wall_seconds));
+        out << line;
+    }
+    out << "reads\t" << reads << "\n";
+    out << "intervals\t" << intervals << "\n";
+    out << "max_intervals_per_read\t" << max_intervals << "\n";
+    for(auto& d : drops) {
+        out << "dropped_" << d.first << "\t" << d.second << "\n";
+    }
+    out << "peak_rss_kb\t" << peak_rss_kb() << std::endl;
+}
+
+bool yacrd::stats::recorder::write_json(const std::string& filename) const
+{
+    std::ofstream out(filename);
+    if(!out) {
+        std::cerr << "Can't open " << filename << std::endl;
+        return false;
+    }
+
+    char line[512];
+    out << "{\n  \"phases\": [";
+    for(std::size_t i = 0 ; i < phases.size() ; i++) {
+        const phase_record& p = phases[i];
+        std::snprintf(line, sizeof(line), "%s\n    {\"name\": \"%s\", \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"bytes\": %llu, "
+                      "\"bytes_per_second\": %.1f, \"lines\": %llu, \"lines_per_second\": %.1f}",
+                      i == 0 ? "" : ",", p.name.c_str(), p.wall_seconds, p.cpu_seconds,
+                      static_cast<unsigned long long>(p.bytes), per_second(p.bytes, p.wall_seconds),
+                      static_cast<unsigned long long>(p.lines), per_second(p.lines, p.wall_seconds));
+        out << line;
+    }
+    out << "\n  ],\n";
+    out << "  \"reads\": " << reads << ",\n";
+    out << "  \"intervals\": " << intervals << ",\n";
+    out << "  \"max_intervals_per_read\": " << max_intervals << ",\n";
+    out << "  \"dropped\": {";
+    for(std::size_t i = 0 ; i < drops.size() ; i++) {
+        out << (i == 0 ? "" : ", ") << "\"" << drops[i].first << "\": " << drops[i].second;
+    }
+    out << "},\n";
+    out << "  \"peak_rss_kb\": " << peak_rss_kb() << "\n}\n";
+    return bool(out);
+}
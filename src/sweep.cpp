@@ -0,0 +1,217 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <algorithm>
+
+/* project include */
+#include "sweep.hpp"
+
+using yacrd::utils::coordinate;
+
+void yacrd::sweep::heap(yacrd::utils::interval* begin, yacrd::utils::interval* end, std::size_t len, std::uint64_t coverage_min, workspace& ws, gaps& out)
+{
+    auto& middle_gaps = out.middle_gaps;
+    auto& stack = ws.stack;
+    middle_gaps.clear();
+    stack = {};
+
+    std::sort(begin, end);
+
+    size_t first_covered = 0;
+    size_t last_covered = 0; // end of the last sufficiently covered interval
+    for(auto it = begin ; it != end ; ++it) {
+        auto interval = *it;
+        // Unstack intervals ending before the beginning of this one
+        while(!stack.empty() && stack.top() < interval.first) {
+            if(stack.size() > coverage_min) {
+                last_covered = stack.top();
+            }
+            stack.pop();
+        }
+
+        // If the new interval will cross the coverage treshold
+        if(stack.size() == coverage_min) {
+            if(last_covered != 0) { // Closing a gap
+                middle_gaps.emplace_back(last_covered, interval.first);
+            } else { // First covered region
+                first_covered = interval.first;
+            }
+        }
+
+        stack.push(interval.second);
+    }
+
+    // Unstack until we reach low coverage region or the end of the read
+    while(stack.size() > coverage_min) {
+        last_covered = stack.top();
+        if(last_covered >= len) {
+            break;
+        }
+        stack.pop();
+    }
+
+    out.first_covered = first_covered;
+    out.last_covered = last_covered;
+}
+
+bool yacrd::sweep::merged(const yacrd::utils::interval* begin, const yacrd::utils::interval* end, gaps& out)
+{
+    out.middle_gaps.clear();
+    out.first_covered = 0;
+    out.last_covered = 0;
+
+    // Each interval is a covered region, what heap() finds when the stack gets empty
+    for(auto it = begin ; it != end ; ++it) {
+        if(it != begin && it->first <= (it - 1)->second) {
+            return false;
+        }
+        if(out.last_covered != 0) {
+            out.middle_gaps.emplace_back(out.last_covered, it->first);
+        } else {
+            out.first_covered = it->first;
+        }
+        out.last_covered = it->second;
+    }
+
+    return true;
+}
+
+void yacrd::sweep::events(yacrd::utils::interval* begin, yacrd::utils::interval* end, std::size_t len, const std::vector<std::uint64_t>& coverage_mins, workspace& ws, std::vector<gaps>& out)
+{
+    auto& begins = ws.begins;
+    auto& ends = ws.ends;
+    auto& order = ws.order;
+
+    std::size_t nb_thresholds = coverage_mins.size();
+    out.resize(nb_thresholds);
+    for(auto& o : out) {
+        o.first_covered = 0;
+        o.last_covered = 0; // end of the last sufficiently covered interval
+        o.middle_gaps.clear();
+    }
+    order.resize(nb_thresholds);
+    for(std::size_t t = 0 ; t < nb_thresholds ; t++) {
+        order[t] = t;
+    }
+    std::sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return coverage_mins[a] < coverage_mins[b]; });
+
+    std::size_t n = std::size_t(end - begin);
+    begins.resize(n);
+    ends.resize(n);
+    for(std::size_t i = 0 ; i < n ; i++) {
+        begins[i] = begin[i].first;
+        ends[i] = begin[i].second;
+    }
+    radix_sort(begins, ws.tmp);
+    radix_sort(ends, ws.tmp);
+
+    // An end event at the position of a begin event is applied after it,
+    // like the heap sweep which only unstack ends strictly before a begin.
+    // Thresholds order[0, below) are strictly lower than the current coverage.
+    std::size_t coverage = 0;
+    std::size_t below = 0;
+    std::size_t j = 0; // next end event
+    for(std::size_t i = 0 ; i < n ; i++) {
+        coordinate pos = begins[i];
+        for(; ends[j] < pos ; j++) {
+            for(std::size_t t = 0 ; t < below ; t++) {
+                out[order[t]].last_covered = ends[j];
+            }
+            coverage--;
+            while(below > 0 && coverage_mins[order[below - 1]] >= coverage) {
+                below--;
+            }
+        }
+
+        // This begin cross thresholds equal to the coverage
+        for(std::size_t t = below ; t < nb_thresholds && coverage_mins[order[t]] == coverage ; t++) {
+            gaps& o = out[order[t]];
+            if(o.last_covered != 0) {
+                o.middle_gaps.emplace_back(coordinate(o.last_covered), pos);
+            } else {
+                o.first_covered = pos;
+            }
+        }
+        coverage++;
+        while(below < nb_thresholds && coverage_mins[order[below]] < coverage) {
+            below++;
+        }
+    }
+
+    // Close intervals until we reach low coverage region or the end of the read
+    for(std::size_t t = 0 ; t < nb_thresholds ; t++) {
+        std::size_t cov = coverage;
+        for(std::size_t k = j ; cov > coverage_mins[t] ; k++) {
+            out[t].last_covered = ends[k];
+            if(ends[k] >= len) {
+                break;
+            }
+            cov--;
+        }
+    }
+}
+
+void yacrd::sweep::radix_sort(std::vector<coordinate>& values, std::vector<coordinate>& tmp)
+{
+    const std::size_t n = values.size();
+    if(n < 64) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    // Three digits of 11 bits, histograms computed in one pass
+    constexpr unsigned digit_bits = 11;
+    constexpr std::size_t nb_buckets = std::size_t(1) << digit_bits;
+    std::vector<std::size_t> counts(3 * nb_buckets, 0);
+    for(coordinate v : values) {
+        counts[v & (nb_buckets - 1)]++;
+        counts[nb_buckets + ((v >> digit_bits) & (nb_buckets - 1))]++;
+        counts[2 * nb_buckets + (v >> (2 * digit_bits))]++;
+    }
+
+    tmp.resize(n);
+    coordinate* src = values.data();
+    coordinate* dst = tmp.data();
+    for(unsigned digit = 0 ; digit < 3 ; digit++) {
+        std::size_t* count = counts.data() + digit * nb_buckets;
+        unsigned shift = digit * digit_bits;
+        if(count[(src[0] >> shift) & (nb_buckets - 1)] == n) { // all values have the same digit
+            continue;
+        }
+
+        std::size_t sum = 0;
+        for(std::size_t b = 0 ; b < nb_buckets ; b++) {
+            std::size_t c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for(std::size_t i = 0 ; i < n ; i++) {
+            dst[count[(src[i] >> shift) & (nb_buckets - 1)]++] = src[i];
+        }
+        std::swap(src, dst);
+    }
+
+    if(src != values.data()) {
+        std::copy(src, src + n, values.data());
+    }
+}
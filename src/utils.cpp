@@ -0,0 +1,313 @@
+/*
+Copyright (c) 2018 Pierre Marijon <pierre.marijon@inria.fr>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/* standard include */
+#include <new>
+#include <atomic>
+#include <algorithm>
+
+/* system include */
+#include <sys/mman.h>
+
+/* project include */
+#include "utils.hpp"
+
+constexpr yacrd::utils::read_id yacrd::utils::name_index::none;
+constexpr std::uint64_t yacrd::utils::name_set::empty;
+constexpr std::uint64_t yacrd::utils::name_set::none;
+
+std::size_t yacrd::utils::name_index::slot(string_ref name, std::uint32_t hash) const
+{
+    std::size_t mask = table.size() - 1;
+    std::size_t pos = hash & mask;
+    while(table[pos] != none && (hashes[table[pos]] != hash || this->name(table[pos]) != name)) {
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+yacrd::utils::read_id yacrd::utils::name_index::find(string_ref name) const
+{
+    return table[slot(name, std::uint32_t(hash_name(name)))];
+}
+
+std::pair<yacrd::utils::read_id, bool> yacrd::utils::name_index::insert(string_ref name)
+{
+    std::uint32_t hash = std::uint32_t(hash_name(name));
+    std::size_t pos = slot(name, hash);
+    if(table[pos] != none) {
+        return std::make_pair(table[pos], false);
+    }
+
+    read_id id = read_id(hashes.size());
+    arena.insert(arena.end(), name.data, name.data + name.size);
+    offsets.push_back(arena.size());
+    hashes.push_back(hash);
+    table[pos] = id;
+
+    // Keep load factor under 1/2
+    if(hashes.size() * 2 > table.size()) {
+        grow();
+    }
+
+    return std::make_pair(id, true);
+}
+
+void yacrd::utils::name_index::assign(std::vector<char> raw_arena, std::vector<std::uint64_t> raw_offsets, std::vector<std::uint32_t> raw_hashes)
+{
+    arena = std::move(raw_arena);
+    offsets = std::move(raw_offsets);
+    hashes = std::move(raw_hashes);
+
+    std::size_t table_size = 16;
+    while(hashes.size() * 2 > table_size) {
+        table_size *= 2;
+    }
+    table.assign(table_size / 2, none);
+    grow();
+}
+
+void yacrd::utils::name_index::grow()
+{
+    table.assign(table.size() * 2, none);
+    std::size_t mask = table.size() - 1;
+    for(read_id id = 0 ; id < hashes.size() ; id++) {
+        std::size_t pos = hashes[id] & mask;
+        while(table[pos] != none) {
+            pos = (pos + 1) & mask;
+        }
+        table[pos] = id;
+    }
+}
+
+yacrd::utils::name_set::name_set(const read_set& reads)
+{
+    const name_index& names = reads.index();
+    if(reads.has_segments()) {
+        segment_offsets.push_back(0);
+    }
+    for(read_id id = 0 ; id < names.size() ; id++) {
+        if(reads.contains(id)) {
+            string_ref name = names.name(id);
+            arena.insert(arena.end(), name.data, name.data + name.size);
+            offsets.push_back(arena.size());
+            if(reads.has_segments()) {
+                segments.insert(segments.end(), reads.covered(id).begin(), reads.covered(id).end());
+                segment_offsets.push_back(segments.size());
+            }
+        }
+    }
+
+    // Keep load factor under 1/2
+    std::size_t table_size = 1;
+    while(size() * 2 >= table_size) {
+        table_size *= 2;
+    }
+    table.assign(table_size, entry{0, empty});
+
+    std::size_t bloom_size = 1;
+    while(bloom_size * 4 < size()) {
+        bloom_size *= 2;
+    }
+    bloom.assign(bloom_size, 0);
+
+    const std::size_t mask = table_size - 1;
+    for(std::uint64_t index = 0 ; index < size() ; index++) {
+        const std::uint64_t hash = hash_name(name(index));
+        bloom[(hash >> 32) & (bloom_size - 1)] |= bloom_bits(hash);
+
+        std::size_t pos = hash & mask;
+        while(table[pos].index != empty) {
+            pos = (pos + 1) & mask;
+        }
+        table[pos] = entry{hash, index};
+    }
+}
+
+void* yacrd::utils::huge_alloc(std::size_t bytes)
+{
+    void* ptr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ptr == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+#ifdef MADV_HUGEPAGE
+    ::madvise(ptr, bytes, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+
+void yacrd::utils::huge_free(void* ptr, std::size_t bytes)
+{
+    ::munmap(ptr, bytes);
+}
+
+constexpr std::size_t yacrd::utils::csr_builder::chunk_size;
+
+std::pair<yacrd::utils::read_id, bool> yacrd::utils::csr_builder::insert(string_ref name, std::uint64_t len, interval iv)
+{
+    auto res = names.insert(name);
+    if(res.second) {
+        lengths.push_back(len);
+    }
+
+    if(log.empty() || log.back().size() == chunk_size) {
+        log.emplace_back();
+        log.back().reserve(chunk_size);
+    }
+    log.back().push_back(entry{res.first, iv});
+
+    return res;
+}
+
+void yacrd::utils::csr_builder::append(csr_builder& other)
+{
+    std::vector<read_id> other2this(other.lengths.size());
+    for(read_id id = 0 ; id < other2this.size() ; id++) {
+        auto res = names.insert(other.names.name(id));
+        if(res.second) {
+            lengths.push_back(other.lengths[id]);
+        }
+        other2this[id] = res.first;
+    }
+
+    for(auto& chunk : other.log) {
+        for(auto& e : chunk) {
+            e.id = other2this[e.id];
+        }
+        if(chunk.size() < chunk_size / 2) { // don't keep the reserved space of a partial chunk
+            chunk.shrink_to_fit();
+        }
+        log.push_back(std::move(chunk));
+    }
+
+    other = csr_builder();
+}
+
+yacrd::utils::read2mapping_csr yacrd::utils::csr_builder::build()
+{
+    read2mapping_csr csr;
+    csr.names = std::move(names);
+    csr.lengths = std::move(lengths);
+
+    // Phase 1: count intervals of each read
+    csr.offsets.assign(csr.lengths.size() + 1, 0);
+    for(auto& chunk : log) {
+        for(auto& e : chunk) {
+            csr.offsets[e.id + 1] += e.id != name_index::none;
+        }
+    }
+    for(std::size_t i = 1 ; i < csr.offsets.size() ; i++) {
+        csr.offsets[i] += csr.offsets[i - 1];
+    }
+
+    // Phase 2: scatter intervals in the arena, release log chunks as we go
+    csr.intervals = huge_array<interval>(csr.offsets.back());
+    std::vector<std::uint64_t> next(csr.offsets.begin(), csr.offsets.end() - 1);
+    for(auto& chunk : log) {
+        for(auto& e : chunk) {
+            if(e.id != name_index::none) {
+                new (&csr.intervals[next[e.id]++]) interval(e.iv);
+            }
+        }
+        std::vector<entry>().swap(chunk);
+    }
+
+    *this = csr_builder();
+    return csr;
+}
+
+std::pair<yacrd::utils::read_id, bool> yacrd::utils::union_builder::insert(string_ref name, std::uint64_t len, interval iv)
+{
+    auto res = names.insert(name);
+    if(res.second) {
+        lengths.push_back(len);
+        intervals.emplace_back();
+        intervals.back().reserve(4);
+    }
+
+    merge_interval(intervals[res.first], iv, lengths[res.first]);
+
+    return res;
+}
+
+void yacrd::utils::union_builder::append(union_builder& other)
+{
+    for(read_id id = 0 ; id < other.lengths.size() ; id++) {
+        auto res = names.insert(other.names.name(id));
+        if(res.second) { // same length, the union is already built
+            lengths.push_back(other.lengths[id]);
+            intervals.push_back(std::move(other.intervals[id]));
+        } else {
+            for(auto& iv : other.intervals[id]) {
+                merge_interval(intervals[res.first], iv, lengths[res.first]);
+            }
+        }
+    }
+
+    other = union_builder();
+}
+
+yacrd::utils::read2mapping_csr yacrd::utils::union_builder::build()
+{
+    read2mapping_csr csr;
+    csr.names = std::move(names);
+    csr.lengths = std::move(lengths);
+
+    csr.offsets.assign(csr.lengths.size() + 1, 0);
+    for(std::size_t id = 0 ; id < intervals.size() ; id++) {
+        csr.offsets[id + 1] = csr.offsets[id] + intervals[id].size();
+    }
+
+    csr.intervals = huge_array<interval>(csr.offsets.back());
+    for(std::size_t id = 0 ; id < intervals.size() ; id++) {
+        std::copy(intervals[id].begin(), intervals[id].end(), csr.intervals.data() + csr.offsets[id]);
+        interval_vector().swap(intervals[id]);
+    }
+
+    *this = union_builder();
+    return csr;
+}
+
+std::uint64_t yacrd::utils::collapse_duplicates(read2mapping_csr& read2mapping, unsigned nb_threads)
+{
+    // Reads are independent: collapse each one in place, then move them down to close the holes
+    std::vector<std::uint64_t> counts(read2mapping.size());
+    std::atomic<std::size_t> next(0);
+    run_threads(nb_threads, [&](unsigned) {
+        for(std::size_t id = next++ ; id < read2mapping.size() ; id = next++) {
+            interval* begin = read2mapping.begin(read_id(id));
+            counts[id] = std::uint64_t(collapse_duplicates(begin, read2mapping.end(read_id(id))) - begin);
+        }
+    });
+
+    std::uint64_t pos = 0;
+    for(read_id id = 0 ; id < read2mapping.size() ; id++) {
+        interval* begin = read2mapping.begin(id);
+        std::copy(begin, begin + counts[id], read2mapping.intervals.data() + pos);
+        read2mapping.offsets[id] = pos;
+        pos += counts[id];
+    }
+
+    const std::uint64_t removed = read2mapping.offsets.back() - pos;
+    read2mapping.offsets.back() = pos;
+    return removed;
+}
@@ -5,12 +5,12 @@ RED='\033[0;31m'
 GREEN='\033[0;32m'
 
 function test_output {
-    diff=$(./build/yacrd -i test/${1}.${2} | diff test/${1}.out -)
+    diff=$(./build/yacrd -i test/${1}.${2} ${3} | diff test/${4:-${1}}.out -)
     if [ "${diff}" == "" ]
     then
-	echo -e "${1}.${2} : ${GREEN}PASSED${NC}"
+	echo -e "${1}.${2} ${3} : ${GREEN}PASSED${NC}"
     else
-	echo -e "${1}.${2} : ${RED}FAILLED${NC}"
+	echo -e "${1}.${2} ${3} : ${RED}FAILLED${NC}"
 	echo ${diff}
     fi
 }
@@ -27,13 +27,281 @@ function test_filter {
     fi
 }
 
+function test_compressed_filter {
+    error=$(./build/yacrd -i test/${1}.${2} -t 4 -f test/${1}.${3} -o test/${1}.filter.${3}.${4} 2>&1 > /dev/null)
+    if [[ "${error}" == *"without support"* ]]
+    then
+	echo -e "${1}.${2} ${3}.${4} : SKIPPED"
+    elif ${5} -t test/${1}.filter.${3}.${4} && [ "$(${5} -dc test/${1}.filter.${3}.${4} | diff test/${1}.filter.${3}.out -)" == "" ]
+    then
+	echo -e "${1}.${2} ${3}.${4} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "${1}.${2} ${3}.${4} : ${RED}FAILLED${NC}"
+    fi
+}
+
+function test_split {
+    ./build/yacrd -i test/${1}.${2} --split -f test/${1}.${3} -o test/${1}.split.${3} > /dev/null
+    diff=$(diff test/${1}.split.${3} test/${1}.split.${3}.out)
+    if [ "${diff}" == "" ]
+    then
+	echo -e "${1}.${2} ${3} --split : ${GREEN}PASSED${NC}"
+    else
+	echo -e "${1}.${2} ${3} --split : ${RED}FAILLED${NC}"
+	echo ${diff}
+    fi
+}
+
+# Each line of the mapping in its own batch, the last report must be the one of the whole mapping
+function test_state {
+    dir=$(mktemp -d)
+    split -l 1 test/${1}.${2} ${dir}/batch.
+    for batch in ${dir}/batch.*
+    do
+	mv ${batch} ${batch}.${2}
+	./build/yacrd -i ${batch}.${2} --state ${dir}/state.ystate ${3} > ${dir}/report
+    done
+    diff=$(diff test/${1}.out ${dir}/report)
+    rm -r ${dir}
+    if [ "${diff}" == "" ]
+    then
+	echo -e "${1}.${2} --state ${3} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "${1}.${2} --state ${3} : ${RED}FAILLED${NC}"
+	echo ${diff}
+    fi
+}
+
+# State of the first batch used with other pre-filters, the run must fail and keep the state
+function test_state_rejected {
+    dir=$(mktemp -d)
+    head -n 1 test/2_extremity_1_middle.paf > ${dir}/a.paf
+    tail -n 1 test/2_extremity_1_middle.paf > ${dir}/b.paf
+    ./build/yacrd -i ${dir}/a.paf --state ${dir}/state.ystate > /dev/null
+    cp ${dir}/state.ystate ${dir}/before.ystate
+    ./build/yacrd -i ${dir}/b.paf --state ${dir}/state.ystate --drop-self > /dev/null 2>&1
+    status=$?
+    if [ ${status} -ne 0 ] && cmp -s ${dir}/before.ystate ${dir}/state.ystate
+    then
+	echo -e "2_extremity_1_middle.paf --state rejected : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.paf --state rejected : ${RED}FAILLED${NC}"
+    fi
+    rm -r ${dir}
+}
+
+# Report of the run saving the index, then of the run loading it
+function test_index {
+    index=$(mktemp)
+    diff=$(./build/yacrd -i test/${1}.${2} --save-index ${index} | diff test/${1}.out -)
+    diff=${diff}$(./build/yacrd -i test/${1}.${2} --load-index ${index} 2>&1 | diff test/${1}.out -)
+    rm ${index}
+    if [ "${diff}" == "" ]
+    then
+	echo -e "${1}.${2} --save-index --load-index : ${GREEN}PASSED${NC}"
+    else
+	echo -e "${1}.${2} --save-index --load-index : ${RED}FAILLED${NC}"
+	echo ${diff}
+    fi
+}
+
+# Line with a read longer than 2^32 appended, it's ignored with a warning
+function test_large_coordinates {
+    input=$(mktemp --suffix=.paf)
+    cat test/2_extremity_1_middle.paf > ${input}
+    printf 'large\t5000000000\t0\t100\t+\t1\t1000\t0\t100\t100\t100\t60\n' >> ${input}
+    diff=$(./build/yacrd -i ${input} ${1} 2> ${input}.err | diff test/2_extremity_1_middle.out -)
+    error=$(cat ${input}.err)
+    rm ${input} ${input}.err
+    if [ "${diff}" == "" ] && [[ "${error}" == *"1 alignments ignored"* ]]
+    then
+	echo -e "2_extremity_1_middle.paf large coordinates ${1} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.paf large coordinates ${1} : ${RED}FAILLED${NC}"
+	echo ${diff} ${error}
+    fi
+}
+
+# Report with options ${3} must be the one of the default run, both with options ${4}.
+# Lines are sorted, --stream writes reads when they are finalized.
+function test_same {
+    diff=$(./build/yacrd -i test/${1}.${2} ${4} ${3} | sort | diff <(./build/yacrd -i test/${1}.${2} ${4} | sort) -)
+    if [ "${diff}" == "" ]
+    then
+	echo -e "${1}.${2} ${4} ${3} same as default : ${GREEN}PASSED${NC}"
+    else
+	echo -e "${1}.${2} ${4} ${3} same as default : ${RED}FAILLED${NC}"
+	echo ${diff}
+    fi
+}
+
+# Statistics and progress go to stderr and to the JSON file, the report doesn't change
+function test_stats {
+    json=$(mktemp)
+    error=$(./build/yacrd -i test/2_extremity_1_middle.${1} --stats --progress --stats-json ${json} ${2} 2>&1 > /dev/null)
+    diff=$(./build/yacrd -i test/2_extremity_1_middle.${1} --stats --progress --stats-json ${json} ${2} 2> /dev/null | diff test/2_extremity_1_middle.out -)
+    content=$(cat ${json})
+    rm ${json}
+    if [ "${diff}" == "" ] && [[ "${error}" == *"peak_rss_kb"* ]] && [[ "${content}" == *'"dropped"'* ]]
+    then
+	echo -e "2_extremity_1_middle.${1} --stats --progress ${2} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.${1} --stats --progress ${2} : ${RED}FAILLED${NC}"
+	echo ${diff} ${error}
+    fi
+}
+
+# Line ${1} appended to the mapping, option ${2} must drop it and count it as ${3}
+function test_prefilter {
+    input=$(mktemp --suffix=.paf)
+    cat test/2_extremity_1_middle.paf > ${input}
+    printf "${1}\n" >> ${input}
+    diff=$(./build/yacrd -i ${input} ${2} 2> ${input}.err | diff test/2_extremity_1_middle.out -)
+    error=$(cat ${input}.err)
+    rm ${input} ${input}.err
+    if [ "${diff}" == "" ] && [[ "${error}" == *"${3}"* ]]
+    then
+	echo -e "2_extremity_1_middle.paf ${2} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.paf ${2} : ${RED}FAILLED${NC}"
+	echo ${diff} ${error}
+    fi
+}
+
+# Option value that must be rejected with the usage
+function test_invalid_option {
+    if ./build/yacrd -i test/2_extremity_1_middle.paf ${1} > /dev/null 2>&1
+    then
+	echo -e "invalid ${1} : ${RED}FAILLED${NC}"
+    else
+	echo -e "invalid ${1} : ${GREEN}PASSED${NC}"
+    fi
+}
+
+# Output on a full device, the run must fail. The report goes to ${2}, /dev/null by default
+function test_write_error {
+    if [ ! -c /dev/full ]
+    then
+	echo -e "write error ${1} : SKIPPED"
+    elif ./build/yacrd -i test/2_extremity_1_middle.paf ${1} > ${2:-/dev/null} 2> /dev/null
+    then
+	echo -e "write error ${1} ${2} : ${RED}FAILLED${NC}"
+    else
+	echo -e "write error ${1} ${2} : ${GREEN}PASSED${NC}"
+    fi
+}
+
+# Mapping compressed with ${1} and cut before its end, the run must fail
+function test_truncated {
+    input=$(mktemp --suffix=.paf.${1})
+    ${2} -c test/2_extremity_1_middle.paf | head -c -8 > ${input}
+    error=$(./build/yacrd -i ${input} ${3} 2>&1 > /dev/null)
+    status=$?
+    rm ${input}
+    if [[ "${error}" == *"without support"* ]]
+    then
+	echo -e "2_extremity_1_middle.paf.${1} truncated ${3} : SKIPPED"
+    elif [ ${status} -ne 0 ] && [[ "${error}" == *"unexpected end of file"* ]]
+    then
+	echo -e "2_extremity_1_middle.paf.${1} truncated ${3} : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.paf.${1} truncated ${3} : ${RED}FAILLED${NC}"
+	echo ${error}
+    fi
+}
+
+# Value ${1} as ${2} little endian bytes
+function le {
+    for ((i = 0 ; i < ${2} ; i++))
+    do
+	printf "\\x$(printf '%02x' $(( (${1} >> (8 * i)) & 255 )))"
+    done
+}
+
+# Header and record of read 1 (length 1000, 3 gaps) written byte by byte
+function test_binary {
+    expected=$(mktemp)
+    {
+	printf 'YACRDREP' ; le 1 4
+	le 0 8 ; le 1000 8 ; le 1 4 ; le 3 4 ; le 0 1 ; printf '1'
+	le 0 8 ; le 100 8 ; le 450 8 ; le 550 8 ; le 900 8 ; le 1000 8
+    } > ${expected}
+    if ./build/yacrd -i test/2_extremity_1_middle.${1} --report-format binary | cmp -s ${expected} -
+    then
+	echo -e "2_extremity_1_middle.${1} --report-format binary : ${GREEN}PASSED${NC}"
+    else
+	echo -e "2_extremity_1_middle.${1} --report-format binary : ${RED}FAILLED${NC}"
+    fi
+    rm ${expected}
+}
+
 test_output "no_coverage" "paf"
 test_output "2_extremity_1_middle" "paf"
 test_output "2_extremity_1_middle" "mhap"
 test_output "2_extremity_1_middle_position_switch" "paf"
+test_output "2_extremity_1_middle" "paf" "--stream"
+test_output "2_extremity_1_middle" "mhap" "--stream"
+test_output "2_extremity_1_middle" "paf.gz"
+test_output "2_extremity_1_middle" "paf" "-c 0,1" "2_extremity_1_middle_multi_coverage"
+test_output "2_extremity_1_middle" "paf" "--sweep events"
+test_output "2_extremity_1_middle" "paf" "--max-memory 64"
+test_output "2_extremity_1_middle" "mhap" "--max-memory 64"
+test_binary "paf"
+test_binary "mhap"
+
+for input in "no_coverage paf" "2_extremity_1_middle paf" "2_extremity_1_middle mhap" "2_extremity_1_middle_position_switch paf" "chimeric_split paf"
+do
+    for base in "" "-c 1" "-c 0,1 --split"
+    do
+	for options in "-t 4" "--stream" "--sweep heap" "--sweep events" "--sweep merged" "--max-memory 64"
+	do
+	    test_same ${input} "${options}" "${base}"
+	done
+    done
+done
+test_stats "paf"
+test_stats "mhap" "--stream"
+test_stats "paf" "--max-memory 64"
+test_prefilter '1\t1000\t0\t1000\t+\t4\t1000\t0\t1000\t10\t10\t255' "--min-block-length 100" "1 short_block"
+test_prefilter '1\t1000\t0\t1000\t+\t4\t1000\t0\t1000\t100\t1000\t255' "--min-identity 0.5" "1 low_identity"
+test_prefilter '1\t1000\t0\t1000\t+\t4\t1000\t0\t1000\t1000\t1000\t0' "--min-mapq 1" "1 low_mapq"
+test_prefilter '1\t1000\t0\t1000\t+\t1\t1000\t0\t1000\t1000\t1000\t255' "--drop-self" "1 self"
+test_prefilter '2\t1000\t550\t900\t+\t1\t1000\t100\t450\t350\t350\t255' "--drop-mirrors" "1 mirrors"
+test_prefilter '2\t1000\t550\t900\t+\t1\t1000\t100\t450\t350\t350\t255' "--drop-mirrors -t 4" "1 mirrors"
+test_prefilter '2\t1000\t550\t900\t+\t1\t1000\t100\t450\t350\t350\t255' "--drop-mirrors --stream" "1 mirrors"
+test_prefilter '2\t1000\t550\t900\t+\t1\t1000\t100\t450\t350\t350\t255' "--drop-mirrors --max-memory 64" "1 mirrors"
+test_invalid_option "-c 99999999999999999999999"
+test_invalid_option "--max-memory 99999999999999999999999"
+test_invalid_option "--min-identity abc"
+test_invalid_option "--min-mapq 1e3"
+test_large_coordinates
+test_large_coordinates "--stream"
+test_truncated "gz" "gzip"
+test_truncated "gz" "gzip" "-t 4"
+test_truncated "gz" "gzip" "--max-memory 64"
+test_truncated "zst" "zstd -q"
 
 test_filter "2_extremity_1_middle" "paf" "paf"
 test_filter "2_extremity_1_middle" "paf" "mhap"
 test_filter "2_extremity_1_middle" "paf" "fasta"
 test_filter "2_extremity_1_middle" "paf" "fastq"
+test_compressed_filter "2_extremity_1_middle" "paf" "fastq" "gz" "gzip"
+test_compressed_filter "2_extremity_1_middle" "paf" "paf" "gz" "gzip"
+test_compressed_filter "2_extremity_1_middle" "paf" "fastq" "zst" "zstd -q"
+test_write_error "-f test/2_extremity_1_middle.fasta -o /dev/full"
+test_write_error "-f test/2_extremity_1_middle.fastq -o /dev/full -t 4"
+test_write_error "--report /nonexistent/report.txt"
+test_write_error "" "/dev/full"
+test_write_error "--stream" "/dev/full"
+test_write_error "--max-memory 64" "/dev/full"
+
+test_split "chimeric_split" "paf" "fasta"
+test_split "chimeric_split" "paf" "fastq"
+
+test_index "2_extremity_1_middle" "paf"
+test_index "2_extremity_1_middle" "mhap"
 
+test_state "2_extremity_1_middle" "paf"
+test_state "2_extremity_1_middle" "mhap"
+test_state "2_extremity_1_middle_position_switch" "paf" "--drop-duplicates"
+test_state_rejected